@@ -0,0 +1,403 @@
+//idocohen963@gmail.com
+
+/**
+ * @file CountedContainer.hpp
+ * @brief Defines a run-length container for duplicate-heavy data
+ */
+#ifndef COUNTEDCONTAINER_HPP
+#define COUNTEDCONTAINER_HPP
+
+#include <vector>
+#include <map>
+#include <mutex>
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <cstddef>
+#include "MyContainer.hpp"
+
+namespace ex4{
+
+    /**
+     * @brief A counted multiset: stores each distinct value once, with the number of copies
+     * @tparam T The type of elements stored in the container (defaults to int)
+     * @tparam Compare Strict weak ordering that defines the ascending order and which values are duplicates
+     * @details Offers the add/remove/size semantics of MyContainer for data with few distinct
+     * values: memory is O(d) for d distinct values instead of O(n), the runs live in an
+     * ordered map so add() and remove() are O(log d), and no sort is ever needed. The
+     * ordered iterators expand the runs lazily: each begin_*() rebuilds a prefix count of
+     * the runs in O(d) if the container changed, and each dereference is an O(log d) binary
+     * search over it, so a full scan costs O(n log d). Insertion order is not kept, so only
+     * the ascending, descending and side-cross orders are available. Values that are
+     * equivalent under Compare count as copies of the first one added. Like MyContainer, a
+     * const container can be scanned from several threads at once.
+     */
+    template<typename T = int, typename Compare = std::less<>>
+    class CountedContainer
+    {
+    public:
+        /// Type of the elements
+        using value_type = T;
+
+    private:
+        template<typename, typename> friend class ex4::IndexIterator;
+
+        std::map<T, size_t, Compare> runs;      ///< Distinct values in ascending order, each with its number of copies
+        size_t total = 0;                       ///< Number of elements, counting every copy
+        size_t generation = 0;                  ///< Bumped on every modification, used to detect stale iterators
+
+        mutable std::vector<const T*> run_values; ///< Value of each run in ascending order, rebuilt by begin_*() for the iterators
+        mutable std::vector<size_t> run_ends;     ///< Position past the last copy of each run, rebuilt along with run_values
+        mutable bool run_ends_stale = false;      ///< Whether run_values and run_ends miss the latest modifications
+        mutable detail::cache_mutex run_mutex;    ///< Serializes the rebuilds of run_values and run_ends
+
+        /**
+         * @brief Bring run_values and run_ends up to date with the runs
+         * @details O(d), and only after a modification. Called by every begin_*(), so the
+         * iterators themselves only read.
+         */
+        void refresh_run_ends() const{
+            std::lock_guard<detail::cache_mutex> lock(run_mutex);
+            if(!run_ends_stale) return;
+            run_values.clear();
+            run_ends.clear();
+            size_t end = 0;
+            for(const auto& run : runs){
+                end += run.second;
+                run_values.push_back(&run.first);
+                run_ends.push_back(end);
+            }
+            run_ends_stale = false;
+        }
+
+        /**
+         * @brief Get the k-th smallest element
+         * @param k Position in ascending order
+         * @return Reference to the value of the run that covers position k
+         * @details O(log d) binary search over the run ends.
+         */
+        const T& sorted_at(size_t k) const{
+            return *run_values[std::upper_bound(run_ends.begin(), run_ends.end(), k) - run_ends.begin()];
+        }
+
+        /**
+         * @brief Record a modification
+         */
+        void modified(){
+            run_ends_stale = true;
+            ++generation;
+        }
+
+        /**
+         * @brief Verify that an iterator is still valid for this container
+         * @param iterator_generation The generation recorded by the iterator
+         * @throws std::runtime_error in debug mode if the container was modified since
+         */
+        void check_generation(size_t iterator_generation) const{
+#if MYCONTAINER_DEBUG_ITERATORS
+            if(iterator_generation != generation) throw std::runtime_error("Iterator used after the container was modified");
+#else
+            (void)iterator_generation;
+#endif
+        }
+
+    public:
+        /**
+         * @brief Default constructor for CountedContainer
+         */
+        CountedContainer() = default;
+
+        /**
+         * @brief Constructor with a comparator
+         * @param comp Strict weak ordering that defines the ascending order
+         */
+        explicit CountedContainer(Compare comp) : runs(std::move(comp)){}
+
+        /**
+         * @brief Copy constructor
+         * @param other The CountedContainer to copy from
+         * @details Copies only the runs: the iterator index of other points into its own map
+         * nodes, so the copy rebuilds its own on its first scan.
+         */
+        CountedContainer(const CountedContainer& other)
+            : runs(other.runs), total(other.total), generation(other.generation), run_ends_stale(true){}
+
+        /**
+         * @brief Assignment operator
+         * @param other The CountedContainer to assign from
+         * @return Reference to this CountedContainer
+         */
+        CountedContainer& operator=(const CountedContainer& other){
+            if(this != &other){
+                runs = other.runs;
+                total = other.total;
+                run_ends_stale = true;
+                ++generation;
+            }
+            return *this;
+        }
+
+        /**
+         * @brief Move constructor
+         * @param other The CountedContainer to move from, left empty
+         * @details The map nodes change owner, so the index is rebuilt on the first scan as well.
+         */
+        CountedContainer(CountedContainer&& other) noexcept(std::is_nothrow_move_constructible<std::map<T, size_t, Compare>>::value)
+            : runs(std::move(other.runs)), total(other.total), generation(other.generation), run_ends_stale(true){
+            other.runs.clear();
+            other.total = 0;
+            other.modified();
+        }
+
+        /**
+         * @brief Move assignment operator
+         * @param other The CountedContainer to move from, left empty
+         * @return Reference to this CountedContainer
+         */
+        CountedContainer& operator=(CountedContainer&& other){
+            if(this != &other){
+                runs = std::move(other.runs);
+                total = other.total;
+                modified();
+                other.runs.clear();
+                other.total = 0;
+                other.modified();
+            }
+            return *this;
+        }
+
+        /**
+         * @brief Add an element to the container
+         * @param element The element to add
+         */
+        void add(const T& element){ add(element, 1); }
+
+        /**
+         * @brief Add several copies of an element at once
+         * @param element The element to add
+         * @param copies Number of copies to add
+         * @details O(log d): one map lookup, and the new run is inserted at the position it found.
+         */
+        void add(const T& element, size_t copies){
+            if(copies == 0) return;
+            auto run = runs.lower_bound(element);
+            if(run != runs.end() && !runs.key_comp()(element, run->first)) run->second += copies;
+            else runs.emplace_hint(run, element, copies);
+            total += copies;
+            modified();
+        }
+
+        /**
+         * @brief Remove an element from the container
+         * @param element The element to remove
+         * @throws std::runtime_error if the element is not found in the container
+         * @details Removes all copies of the element in O(log d): a map lookup finds its run,
+         * which is then erased.
+         */
+        void remove(const T& element){
+            auto run = runs.find(element);
+            if(run == runs.end()){
+                throw std::runtime_error("Element was not found in the container");
+            }
+            total -= run->second;
+            runs.erase(run);
+            modified();
+        }
+
+        /**
+         * @brief Get the number of elements in the container
+         * @return The number of elements as size_t, counting every copy
+         */
+        size_t size() const{ return total; }
+
+        /**
+         * @brief Get the number of distinct elements in the container
+         * @return The number of runs
+         */
+        size_t distinct_size() const{ return runs.size(); }
+
+        /**
+         * @brief Count the copies of an element
+         * @param element The element to look for
+         * @return The number of copies, 0 if the element is not in the container
+         */
+        size_t count(const T& element) const{
+            auto run = runs.find(element);
+            return run == runs.end() ? 0 : run->second;
+        }
+
+        /**
+         * @brief Stream insertion operator for CountedContainer
+         * @param os The output stream
+         * @param container The container to output
+         * @return Reference to the output stream
+         * @details Formats the container like MyContainer, listing every copy in ascending order
+         */
+        friend std::ostream& operator<<(std::ostream& os, const CountedContainer& container){
+            os << "[";
+            bool first = true;
+            for(const auto& run : container.runs){
+                for(size_t i = 0; i < run.second; ++i){
+                    if(!first) os << ", ";
+                    os << run.first;
+                    first = false;
+                }
+            }
+            os << "]";
+            return os;
+        }
+
+        /// Past-the-end marker returned by every end_*() function
+        using Sentinel = OrderSentinel<CountedContainer>;
+
+        /// Random-access machinery shared by the iterator types (see ex4::IndexIterator)
+        template<typename Derived>
+        using IndexIterator = ex4::IndexIterator<CountedContainer, Derived>;
+
+        /**
+         * @brief Iterator that traverses elements in ascending order
+         * @details Position k maps to the run covering it, found in O(log d) by binary search
+         * over the run ends, so the copies are never materialized.
+         */
+        class AscendingIterator : public IndexIterator<AscendingIterator>{
+
+            using Base = IndexIterator<AscendingIterator>;
+            friend Base;
+
+            /**
+             * @brief Element at a position of the ascending order
+             * @param k Position in the iteration
+             * @return Reference to the k-th smallest element
+             */
+            const T& element_at(size_t k) const { return this->owner->sorted_at(k); }
+
+            /**
+             * @brief Number of positions in the ascending order
+             * @return The size of the owner container
+             */
+            size_t order_size() const { return this->owner->total; }
+
+            public:
+            using Base::Base;
+        };
+
+        /**
+         * @brief Get an iterator to the beginning of the container in ascending order
+         * @return AscendingIterator pointing to the smallest element
+         */
+        AscendingIterator begin_ascending_order() const{
+            refresh_run_ends();
+            return AscendingIterator(0, this);
+        }
+
+        /**
+         * @brief Get the end sentinel of the container in ascending order
+         * @return Sentinel that compares equal to an iterator past the largest element
+         */
+        Sentinel end_ascending_order() const { return Sentinel(this); }
+
+        /**
+         * @brief Iterator that traverses elements in descending order
+         */
+        class DescendingOrder : public IndexIterator<DescendingOrder>{
+
+            using Base = IndexIterator<DescendingOrder>;
+            friend Base;
+
+            /**
+             * @brief Element at a position of the descending order
+             * @param k Position in the iteration
+             * @return Reference to the k-th largest element
+             */
+            const T& element_at(size_t k) const { return this->owner->sorted_at(this->owner->total - 1 - k); }
+
+            /**
+             * @brief Number of positions in the descending order
+             * @return The size of the owner container
+             */
+            size_t order_size() const { return this->owner->total; }
+
+            public:
+            using Base::Base;
+        };
+
+        /**
+         * @brief Get an iterator to the beginning of the container in descending order
+         * @return DescendingOrder pointing to the largest element
+         */
+        DescendingOrder begin_descending_order() const{
+            refresh_run_ends();
+            return DescendingOrder(0, this);
+        }
+
+        /**
+         * @brief Get the end sentinel of the container in descending order
+         * @return Sentinel that compares equal to an iterator past the smallest element
+         */
+        Sentinel end_descending_order() const { return Sentinel(this); }
+
+        /**
+         * @brief Iterator that alternates between the smallest and largest remaining elements
+         */
+        class SideCrossIterator : public IndexIterator<SideCrossIterator>{
+
+            using Base = IndexIterator<SideCrossIterator>;
+            friend Base;
+
+            /**
+             * @brief Element at a position of the side-cross order
+             * @param k Position in the iteration
+             * @return Reference to the element visited k-th
+             */
+            const T& element_at(size_t k) const {
+                return this->owner->sorted_at(k % 2 == 0 ? k / 2 : this->owner->total - 1 - k / 2);
+            }
+
+            /**
+             * @brief Number of positions in the side-cross order
+             * @return The size of the owner container
+             */
+            size_t order_size() const { return this->owner->total; }
+
+            public:
+            using Base::Base;
+        };
+
+        /**
+         * @brief Get an iterator to the beginning of the container in side-cross order
+         * @return SideCrossIterator pointing to the smallest element
+         */
+        SideCrossIterator begin_side_cross_order() const{
+            refresh_run_ends();
+            return SideCrossIterator(0, this);
+        }
+
+        /**
+         * @brief Get the end sentinel of the container in side-cross order
+         * @return Sentinel that compares equal to an iterator past the last visited element
+         */
+        Sentinel end_side_cross_order() const { return Sentinel(this); }
+
+        /**
+         * @brief View of the container in ascending order
+         * @return OrderView over AscendingIterator
+         */
+        OrderView<AscendingIterator> ascending() const { return OrderView<AscendingIterator>(begin_ascending_order(), size()); }
+
+        /**
+         * @brief View of the container in descending order
+         * @return OrderView over DescendingOrder
+         */
+        OrderView<DescendingOrder> descending() const { return OrderView<DescendingOrder>(begin_descending_order(), size()); }
+
+        /**
+         * @brief View of the container in side-cross order
+         * @return OrderView over SideCrossIterator
+         */
+        OrderView<SideCrossIterator> side_cross() const { return OrderView<SideCrossIterator>(begin_side_cross_order(), size()); }
+    };
+}
+
+#endif
@@ -11,19 +11,1297 @@
 #include <iostream>
 #include <stdexcept>
 #include <algorithm>
+#include <type_traits>
+#include <iterator>
+#include <cstddef>
+#include <functional>
+#include <utility>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <unordered_map>
+#include <initializer_list>
+#include "SortAlgorithms.hpp"
+#if __cplusplus >= 202002L
+#include <ranges>
+#endif
 
+/**
+ * @brief Enables detection of iterators used after the container was modified
+ * @details Defaults to on unless NDEBUG is defined. When enabled, dereferencing an
+ * iterator created before an add() or remove() throws std::runtime_error.
+ */
+#ifndef MYCONTAINER_DEBUG_ITERATORS
+#ifdef NDEBUG
+#define MYCONTAINER_DEBUG_ITERATORS 0
+#else
+#define MYCONTAINER_DEBUG_ITERATORS 1
+#endif
+#endif
 
 namespace ex4{
 
+    /**
+     * @brief Selects whether the ordered iterators of MyContainer<T> sort indices instead of copies
+     * @tparam T The element type
+     * @details In indirect mode the sorted snapshot is a permutation of indices into the
+     * container's storage and no element is ever copied. This is the default for types
+     * that are not trivially copyable (such as std::string) or larger than two pointers.
+     * Specialize for a user type to override the choice.
+     */
+    template<typename T>
+    struct sort_by_index
+        : std::integral_constant<bool, !std::is_trivially_copyable<T>::value || (sizeof(T) > 2 * sizeof(void*))> {};
+
+    namespace detail{
+
+        /**
+         * @brief Process-wide thread count for sorting, 0 meaning one per hardware thread
+         * @return Reference to the setting
+         */
+        inline std::atomic<size_t>& default_sort_threads_setting(){
+            static std::atomic<size_t> threads(0);
+            return threads;
+        }
+
+        /**
+         * @brief Whether std::hash is enabled for T, which the optional hash index of MyContainer needs
+         * @tparam T The element type
+         */
+        template<typename T>
+        struct is_hashable : std::is_default_constructible<std::hash<T>> {};
+
+        /**
+         * @brief Whether a range passed as Range&& owns its elements, so they may be moved out of it
+         * @tparam Range The deduced range type, an lvalue reference for an lvalue argument
+         * @details An rvalue view (std::views::all, std::span, ...) or borrowed range refers
+         * to elements owned elsewhere, which must be copied. Before C++20 the two cannot be
+         * told apart, so no range is moved from.
+         */
+        template<typename Range>
+        struct owns_elements : std::integral_constant<bool,
+#if __cplusplus >= 202002L
+            !std::is_lvalue_reference<Range>::value
+            && !std::ranges::view<std::remove_cvref_t<Range>>
+            && !std::ranges::borrowed_range<Range>
+#else
+            false
+#endif
+        > {};
+
+        /**
+         * @brief Mutex guarding the lazily built caches of a container
+         * @details Copying or assigning it yields an unlocked mutex and leaves the target's
+         * alone, so containers holding one keep their implicit copy and move operations: the
+         * caches of one container are never shared with its copies.
+         */
+        struct cache_mutex{
+            std::mutex mutex; ///< The guarding mutex
+
+            /**
+             * @brief Construct an unlocked mutex
+             */
+            cache_mutex() = default;
+
+            /**
+             * @brief Construct an unlocked mutex (nothing is copied)
+             */
+            cache_mutex(const cache_mutex&) noexcept {}
+
+            /**
+             * @brief Assignment, which keeps this mutex
+             * @return Reference to this mutex
+             */
+            cache_mutex& operator=(const cache_mutex&) noexcept { return *this; }
+
+            /**
+             * @brief Lock the mutex, blocking until it is available
+             */
+            void lock(){ mutex.lock(); }
+
+            /**
+             * @brief Unlock the mutex
+             */
+            void unlock() noexcept { mutex.unlock(); }
+        };
+    }
+
+    /**
+     * @brief Set how many threads containers use to sort large snapshots by default
+     * @param threads Number of threads, or 0 for one per hardware thread
+     * @details Applies to every container that has no setting of its own (see MyContainer::set_sort_threads).
+     */
+    inline void set_default_sort_threads(size_t threads){ detail::default_sort_threads_setting().store(threads); }
+
+    /**
+     * @brief Get how many threads containers use to sort large snapshots by default
+     * @return The configured number of threads, resolved to the hardware thread count if set to 0
+     */
+    inline size_t default_sort_threads(){
+        size_t threads = detail::default_sort_threads_setting().load();
+        if(threads == 0) threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+        return threads;
+    }
+
+    /**
+     * @brief Projection that returns its argument unchanged, the default projection of MyContainer
+     * @details Same role as std::identity, which is not available before C++20.
+     */
+    struct identity{
+        /**
+         * @brief Return the argument unchanged
+         * @param value Any value
+         * @return value, perfectly forwarded
+         */
+        template<typename U>
+        constexpr U&& operator()(U&& value) const noexcept { return std::forward<U>(value); }
+
+        using is_transparent = void; ///< Marks the projection as type-agnostic
+    };
+
+    /**
+     * @brief Predicate matching the elements equal to a value
+     * @tparam T The type of the value
+     * @details MyContainer::remove_if() recognizes it and removes the matches with the same
+     * vectorized pass as try_remove(), which an equivalent lambda cannot get.
+     */
+    template<typename T>
+    struct equals{
+        T value; ///< The value to match
+
+        /**
+         * @brief Construct the predicate
+         * @param v The value to match
+         */
+        explicit equals(T v) : value(std::move(v)){}
+
+        /**
+         * @brief Test an element
+         * @param element The element
+         * @return True if element == value
+         */
+        bool operator()(const T& element) const { return element == value; }
+    };
+
+    /// Deduces equals<T> from the value, e.g. equals(5) is an equals<int>
+    template<typename T>
+    equals(T) -> equals<T>;
+
+    /**
+     * @brief Lightweight range over one of the orders of a MyContainer
+     * @tparam Iterator The iterator type of the order
+     * @details Holds only a begin iterator and a length; it never copies elements.
+     * Usable with range-for and the standard algorithms, and under C++20 it models
+     * std::ranges::random_access_range, sized_range and view, so it composes lazily
+     * with std::views::take, filter, transform, etc. The view is invalidated by the
+     * same modifications that invalidate its iterators.
+     */
+    template<typename Iterator>
+    class OrderView
+#if __cplusplus >= 202002L
+        : public std::ranges::view_interface<OrderView<Iterator>>
+#endif
+    {
+    private:
+        Iterator first;   ///< Iterator to the first element of the order
+        size_t count = 0; ///< Number of elements in the order
+
+    public:
+        using iterator = Iterator;                                                  ///< Iterator type of the view
+        using value_type = typename std::iterator_traits<Iterator>::value_type;     ///< Type of the elements
+
+        /**
+         * @brief Default constructor, creates an empty view
+         */
+        OrderView() = default;
+
+        /**
+         * @brief Constructor for OrderView
+         * @param begin Iterator to the first element of the order
+         * @param size Number of elements in the order
+         */
+        OrderView(Iterator begin, size_t size) : first(begin), count(size){}
+
+        /**
+         * @brief Get an iterator to the first element
+         * @return Iterator to the beginning of the order
+         */
+        Iterator begin() const { return first; }
+
+        /**
+         * @brief Get an iterator past the last element
+         * @return Iterator to the end of the order
+         */
+        Iterator end() const { return first + static_cast<std::ptrdiff_t>(count); }
+
+        /**
+         * @brief Get the number of elements in the view
+         * @return The number of elements as size_t
+         */
+        size_t size() const { return count; }
+
+        /**
+         * @brief Check whether the view is empty
+         * @return True if the view has no elements
+         */
+        bool empty() const { return count == 0; }
+
+        /**
+         * @brief Subscript operator
+         * @param k Position in the order
+         * @return Reference to the k-th element of the order
+         * @throws std::out_of_range if k is out of bounds
+         */
+        const value_type& operator[](size_t k) const { return first[static_cast<std::ptrdiff_t>(k)]; }
+    };
+
+    /**
+     * @brief Past-the-end marker returned by every end_*() function of a container
+     * @tparam Owner The container type
+     * @details Holds only the owner pointer, so producing it never copies or sorts the
+     * elements. Every iterator type compares equal to it once it has visited all elements.
+     */
+    template<typename Owner>
+    class OrderSentinel{
+
+        private:
+        const Owner* owner;   ///< Pointer to the container the sentinel belongs to
+
+        public:
+        /**
+         * @brief Constructor for OrderSentinel
+         * @param container Pointer to the owner container
+         */
+        explicit OrderSentinel(const Owner* container = nullptr) : owner(container){}
+
+        /**
+         * @brief Get the container this sentinel belongs to
+         * @return Pointer to the owner container
+         */
+        const Owner* container() const { return owner; }
+    };
+
+    /**
+     * @brief Random-access machinery shared by the iterator types of the containers
+     * @tparam Owner The container type, which exposes value_type and befriends this class
+     * @tparam Derived The concrete iterator type
+     * @details An iterator is a position in one of the container's orders. Derived
+     * classes map a position to an element through element_at() and report the length
+     * of their order through order_size(); everything else (arithmetic, comparisons,
+     * bounds and staleness checks) lives here. The owner provides a generation counter
+     * and check_generation().
+     */
+    template<typename Owner, typename Derived>
+    class IndexIterator{
+
+        public:
+        using iterator_category = std::random_access_iterator_tag; ///< Iterator category for std::iterator_traits
+        using value_type = typename Owner::value_type;             ///< Type of the elements
+        using difference_type = std::ptrdiff_t;                    ///< Type of the distance between two iterators
+        using pointer = const value_type*;                         ///< Pointer to an element
+        using reference = const value_type&;                       ///< Reference to an element
+
+        protected:
+        size_t current_index;          ///< Current position in the iteration
+        const Owner* owner;            ///< Pointer to the container being iterated
+        size_t generation;             ///< Owner generation at the time this iterator was created
+
+        /**
+         * @brief Access the concrete iterator
+         * @return Reference to this iterator as Derived
+         */
+        const Derived& derived() const { return static_cast<const Derived&>(*this); }
+
+        /**
+         * @brief Number of positions left before the end of this iterator's order
+         * @return Length of the order minus the current position
+         */
+        difference_type remaining() const {
+            return static_cast<difference_type>(derived().order_size()) - static_cast<difference_type>(current_index);
+        }
+
+        public:
+        /**
+         * @brief Default constructor, creates an iterator that belongs to no container
+         */
+        IndexIterator() : current_index(0), owner(nullptr), generation(0){}
+
+        /**
+         * @brief Constructor for IndexIterator
+         * @param index Starting position for iteration
+         * @param container Pointer to the owner container
+         */
+        IndexIterator(size_t index, const Owner* container)
+            : current_index(index), owner(container), generation(container->generation){}
+
+        /**
+         * @brief Dereference operator
+         * @return Reference to the current element
+         * @throws std::out_of_range if iterator is out of bounds
+         * @throws std::runtime_error in debug mode if the container was modified after the iterator was created
+         */
+        reference operator*() const { return (*this)[0]; }
+
+        /**
+         * @brief Member access operator
+         * @return Pointer to the current element
+         * @throws std::out_of_range if iterator is out of bounds
+         */
+        pointer operator->() const { return &(*this)[0]; }
+
+        /**
+         * @brief Subscript operator
+         * @param offset Distance from the current position (may be negative)
+         * @return Reference to the element offset positions away in this iterator's order
+         * @throws std::out_of_range if the position is out of bounds
+         * @throws std::runtime_error in debug mode if the container was modified after the iterator was created
+         */
+        reference operator[](difference_type offset) const {
+            owner->check_generation(generation);
+            size_t k = current_index + static_cast<size_t>(offset);
+            if(k >= derived().order_size()) throw std::out_of_range("Iterator out of bounds");
+            return derived().element_at(k);
+        }
+
+        /**
+         * @brief Pre-increment operator
+         * @return Reference to this iterator after advancement
+         */
+        Derived& operator++(){ ++current_index; return static_cast<Derived&>(*this); }
+
+        /**
+         * @brief Post-increment operator
+         * @return Copy of the iterator before advancement
+         */
+        Derived operator++(int){
+            Derived tmp = derived();
+            ++current_index;
+            return tmp;
+        }
+
+        /**
+         * @brief Pre-decrement operator
+         * @return Reference to this iterator after moving back one position
+         */
+        Derived& operator--(){ --current_index; return static_cast<Derived&>(*this); }
+
+        /**
+         * @brief Post-decrement operator
+         * @return Copy of the iterator before moving back
+         */
+        Derived operator--(int){
+            Derived tmp = derived();
+            --current_index;
+            return tmp;
+        }
+
+        /**
+         * @brief Advance the iterator in place
+         * @param offset Number of positions to advance (may be negative)
+         * @return Reference to this iterator
+         */
+        Derived& operator+=(difference_type offset){
+            current_index += static_cast<size_t>(offset);
+            return static_cast<Derived&>(*this);
+        }
+
+        /**
+         * @brief Move the iterator back in place
+         * @param offset Number of positions to move back (may be negative)
+         * @return Reference to this iterator
+         */
+        Derived& operator-=(difference_type offset){
+            current_index -= static_cast<size_t>(offset);
+            return static_cast<Derived&>(*this);
+        }
+
+        /**
+         * @brief Advance a copy of the iterator
+         * @param it The iterator to start from
+         * @param offset Number of positions to advance (may be negative)
+         * @return Iterator offset positions away from it
+         */
+        friend Derived operator+(const Derived& it, difference_type offset){
+            Derived tmp = it;
+            tmp += offset;
+            return tmp;
+        }
+
+        /**
+         * @brief Advance a copy of the iterator (offset on the left)
+         */
+        friend Derived operator+(difference_type offset, const Derived& it){ return it + offset; }
+
+        /**
+         * @brief Move a copy of the iterator back
+         * @param it The iterator to start from
+         * @param offset Number of positions to move back (may be negative)
+         * @return Iterator offset positions before it
+         */
+        friend Derived operator-(const Derived& it, difference_type offset){
+            Derived tmp = it;
+            tmp -= offset;
+            return tmp;
+        }
+
+        /**
+         * @brief Distance between two iterators of the same container
+         * @param a The later iterator
+         * @param b The earlier iterator
+         * @return Number of increments needed to get from b to a
+         */
+        friend difference_type operator-(const Derived& a, const Derived& b){
+            return static_cast<difference_type>(a.current_index) - static_cast<difference_type>(b.current_index);
+        }
+
+        /**
+         * @brief Distance from an iterator to the end sentinel
+         * @param end The sentinel
+         * @param it The iterator
+         * @return Number of elements left to visit
+         */
+        friend difference_type operator-(const OrderSentinel<Owner>& end, const Derived& it){
+            (void)end;
+            return it.remaining();
+        }
+
+        /**
+         * @brief Distance from the end sentinel to an iterator
+         */
+        friend difference_type operator-(const Derived& it, const OrderSentinel<Owner>& end){ return -(end - it); }
+
+        /**
+         * @brief Equality comparison operator
+         * @param a The first iterator
+         * @param b The iterator to compare with
+         * @return True if both iterators belong to the same container and point to the same index
+         */
+        friend bool operator==(const Derived& a, const Derived& b){
+            return a.owner == b.owner && a.current_index == b.current_index;
+        }
+
+        /**
+         * @brief Inequality comparison operator
+         * @param a The first iterator
+         * @param b The iterator to compare with
+         * @return True if iterators are not equal
+         */
+        friend bool operator!=(const Derived& a, const Derived& b){ return !(a == b); }
+
+        /**
+         * @brief Ordering of two iterators of the same container
+         * @param a The first iterator
+         * @param b The iterator to compare with
+         * @return True if a is at an earlier position than b
+         */
+        friend bool operator<(const Derived& a, const Derived& b){ return a.current_index < b.current_index; }
+
+        /**
+         * @brief Ordering of two iterators of the same container
+         */
+        friend bool operator>(const Derived& a, const Derived& b){ return b < a; }
+
+        /**
+         * @brief Ordering of two iterators of the same container
+         */
+        friend bool operator<=(const Derived& a, const Derived& b){ return !(b < a); }
+
+        /**
+         * @brief Ordering of two iterators of the same container
+         */
+        friend bool operator>=(const Derived& a, const Derived& b){ return !(a < b); }
+
+        /**
+         * @brief Comparison with the end sentinel
+         * @param it The iterator to compare
+         * @param end The sentinel to compare with
+         * @return True if the iterator belongs to the sentinel's container and has visited all elements
+         */
+        friend bool operator==(const Derived& it, const OrderSentinel<Owner>& end){
+            return it.owner == end.container() && it.remaining() == 0;
+        }
+
+        /**
+         * @brief Comparison with the end sentinel (sentinel on the left)
+         */
+        friend bool operator==(const OrderSentinel<Owner>& end, const Derived& it){ return it == end; }
+
+        /**
+         * @brief Inequality comparison with the end sentinel
+         */
+        friend bool operator!=(const Derived& it, const OrderSentinel<Owner>& end){ return !(it == end); }
+
+        /**
+         * @brief Inequality comparison with the end sentinel (sentinel on the left)
+         */
+        friend bool operator!=(const OrderSentinel<Owner>& end, const Derived& it){ return !(it == end); }
+    };
+
     /**
      * @brief A template container class that stores elements and provides various iterators
      * @tparam T The type of elements stored in the container (defaults to int)
+     * @tparam Compare Strict weak ordering on projected elements that defines the ascending order
+     * @tparam Projection Maps an element to the key it is ordered by (defaults to the element itself)
+     * @details With a projection, each key is computed once per element and cached in the
+     * sorted snapshot next to the element's index, so sorting never re-runs the projection.
+     * Const member functions, iterators and views may be used from several threads at once:
+     * the lazily sorted snapshot they share is refreshed and settled under a mutex. Any
+     * modification needs exclusive access, as with the standard containers.
      */
-    template<typename T = int>
+    template<typename T = int, typename Compare = std::less<>, typename Projection = identity>
     class MyContainer
     {
+    public:
+        /// Type of the elements
+        using value_type = T;
+        /// Type of the keys the elements are ordered by
+        using key_type = typename std::decay<typename std::invoke_result<const Projection&, const T&>::type>::type;
+
     private:
-        std::vector<T> elements; ///< Internal storage for container elements
+        template<typename, typename> friend class ex4::IndexIterator;
+
+        std::vector<T> elements; ///< Internal storage for container elements, including removed ones awaiting compaction (see dead_slots)
+        size_t generation = 0;   ///< Bumped on every modification, used to detect stale iterators
+        size_t sort_thread_count = 0; ///< Threads used to sort large snapshots, 0 to follow default_sort_threads()
+        Compare compare;         ///< Ordering of the keys
+        Projection projection;   ///< Maps an element to its key
+
+        /// Elements are ordered by a projected key, cached in the snapshot as (key, index) pairs
+        static constexpr bool keyed_sort = !std::is_same<Projection, identity>::value;
+        /// Elements are ordered by operator< on T, which enables the radix, network and string sorts
+        static constexpr bool natural_order = !keyed_sort
+            && (std::is_same<Compare, std::less<>>::value || std::is_same<Compare, std::less<T>>::value);
+        /// Ordered iterators sort element indices instead of element copies (see sort_by_index)
+        static constexpr bool indirect_sort = keyed_sort || sort_by_index<T>::value;
+
+        /**
+         * @brief Snapshot entry of a keyed container: a cached key and the index of its element
+         */
+        struct keyed_slot{
+            key_type key; ///< Projection of the element
+            size_t index; ///< Index of the element in elements
+        };
+
+        /// Entry of the sorted snapshot: a keyed_slot with a projection, an index into elements in indirect mode, a copy of the element otherwise
+        using slot_type = typename std::conditional<keyed_sort, keyed_slot,
+                          typename std::conditional<indirect_sort, size_t, T>::type>::type;
+
+        /// Key of each element in keyed mode, computed once by add(); unused otherwise
+        std::vector<typename std::conditional<keyed_sort, key_type, char>::type> cached_keys;
+        size_t descents = 0; ///< Number of elements whose key orders before the key of the element added just before them
+
+        /// Value statistics are tracked for arithmetic elements under the natural order, where they select the sort strategy
+        static constexpr bool tracks_stats = natural_order && detail::radix_traits<T>::enabled;
+        /// Statistics of the elements (see detail::value_stats), updated by add(), rebuilt by remove_all() and remove_if(), and left as statistics of a superset by try_remove()
+        typename std::conditional<tracks_stats, detail::value_stats<T>, char>::type stats{};
+
+        /// The hash index needs std::hash<T> and copies of the values as its keys
+        static constexpr bool hash_indexable = detail::is_hashable<T>::value && std::is_copy_constructible<T>::value;
+        /// Type of the hash index
+        using value_counts_type = typename std::conditional<hash_indexable, std::unordered_map<T, size_t>, char>::type;
+        /// Number of instances of each value, maintained only while the hash index is enabled (see set_hash_index)
+        value_counts_type value_counts{};
+        bool hash_indexed = false; ///< Whether value_counts is enabled and up to date
+
+        double compaction_ratio = 0;               ///< Dead fraction of elements that triggers compaction, 0 to remove eagerly (see set_compaction_threshold)
+        std::vector<std::uint64_t> dead_slots;     ///< Bitmap of the elements removed but not compacted away yet
+        size_t dead_count = 0;                     ///< Number of bits set in dead_slots
+        std::vector<size_t> live_before_word;      ///< Live elements before each word of dead_slots, plus the live total of all its words
+        /// Values removed lazily whose snapshot entries were not dropped yet; direct mode only (see drop_dead_from_snapshot)
+        mutable typename std::conditional<indirect_sort, char, std::vector<T>>::type undropped_removals{};
+        mutable size_t snapshot_dead = 0;          ///< Number of dead elements whose snapshot entries were already dropped
+
+        mutable std::vector<slot_type> sorted_snapshot; ///< Cached ascending order of elements, shared by the ordered iterators
+        mutable size_t sorted_count = 0;                ///< Number of leading elements already merged into sorted_snapshot
+        mutable std::atomic<size_t> settled_low{0};     ///< Snapshot positions below this are in their final sorted place
+        mutable std::atomic<size_t> settled_high{0};    ///< Snapshot positions from this one on are in their final sorted place
+        mutable detail::cache_mutex snapshot_mutex;     ///< Serializes the refreshes and lazy sorting of the snapshot by const functions
+
+        /// Smallest number of positions settled at once by a lazy ordered scan
+        static constexpr size_t lazy_sort_chunk = 32;
+
+        /**
+         * @brief Get the element a snapshot entry refers to
+         * @param slot Entry of the sorted snapshot
+         * @return Reference to the element (inside elements in indirect mode)
+         */
+        const T& slot_value(const slot_type& slot) const{
+            if constexpr (keyed_sort) return elements[slot.index];
+            else if constexpr (indirect_sort) return elements[slot];
+            else return slot;
+        }
+
+        /**
+         * @brief Get the index stored in a snapshot entry
+         * @param slot Entry of the sorted snapshot (indirect mode only)
+         * @return Reference to the index into elements
+         */
+        size_t& slot_index(slot_type& slot) const{
+            if constexpr (keyed_sort) return slot.index;
+            else return slot;
+        }
+
+        /**
+         * @brief Build the snapshot entry of an element
+         * @param i Index of the element
+         * @return The entry, with the key computed in keyed mode
+         */
+        slot_type make_slot(size_t i) const{
+            if constexpr (keyed_sort) return slot_type{cached_keys[i], i};
+            else if constexpr (indirect_sort) return i;
+            else return elements[i];
+        }
+
+        /**
+         * @brief Get the key of an element, computing its projection
+         * @param element The element
+         * @return The element itself, or its projection in keyed mode
+         */
+        decltype(auto) element_key(const T& element) const{
+            if constexpr (keyed_sort) return key_type(std::invoke(projection, element));
+            else return (element);
+        }
+
+        /**
+         * @brief Get the key of a stored element without computing anything
+         * @param i Index of the element
+         * @return Reference to the cached key in keyed mode, to the element otherwise
+         */
+        const key_type& key_at(size_t i) const{
+            if constexpr (keyed_sort) return cached_keys[i];
+            else return elements[i];
+        }
+
+        /**
+         * @brief Get the key of a snapshot entry without computing anything
+         * @param slot Entry of the sorted snapshot
+         * @return Reference to the cached key in keyed mode, to the element otherwise
+         */
+        const key_type& slot_key(const slot_type& slot) const{
+            if constexpr (keyed_sort) return slot.key;
+            else return slot_value(slot);
+        }
+
+        /// Elements are sorted by the radix kernels, whose key order the container follows everywhere (see key_less)
+        static constexpr bool radix_ordered = natural_order && !indirect_sort && detail::radix_traits<T>::enabled;
+
+        /**
+         * @brief Compare two keys in the order of the sorted snapshot
+         * @param a The first key
+         * @param b The second key
+         * @return True if a orders before b
+         * @details The comparator, except for elements sorted by the radix kernels, which
+         * order them by radix key: -0.0 before +0.0, unlike operator<. Using the same order
+         * for the descents, the lazy partitioning, the merges and the binary searches keeps
+         * them consistent with the kernels.
+         */
+        bool key_less(const key_type& a, const key_type& b) const{
+            if constexpr (radix_ordered) return detail::radix_traits<T>::key(a) < detail::radix_traits<T>::key(b);
+            else return compare(a, b);
+        }
+
+        /**
+         * @brief Compare two snapshot entries by their keys
+         * @param a The first entry
+         * @param b The second entry
+         * @return True if a's key orders before b's key
+         */
+        bool slot_less(const slot_type& a, const slot_type& b) const{ return key_less(slot_key(a), slot_key(b)); }
+
+        /**
+         * @brief Check whether every position of the snapshot is in its final sorted place
+         * @return True if the snapshot is fully sorted
+         */
+        bool snapshot_settled() const{ return settled_low >= settled_high; }
+
+        /**
+         * @brief Get the k-th smallest element from the sorted snapshot
+         * @param k Position in ascending order
+         * @return Reference to the element
+         * @details Settles position k first if a lazy scan has not reached it yet. Settled
+         * positions never move again, so they are read without locking; settling takes
+         * snapshot_mutex and publishes the new bounds only once the positions are sorted.
+         */
+        const T& sorted_at(size_t k) const{
+            if(k >= settled_low.load(std::memory_order_acquire) && k < settled_high.load(std::memory_order_acquire)){
+                std::lock_guard<detail::cache_mutex> lock(snapshot_mutex);
+                settle_sorted_position(k);
+            }
+            return slot_value(sorted_snapshot[k]);
+        }
+
+        /**
+         * @brief Sort a range of snapshot positions in ascending order
+         * @param first First position of the range
+         * @param last Position past the end of the range
+         * @details Under the natural order, arithmetic elements stored by copy go through
+         * detail::sort_arithmetic(), which picks insertion, natural merge, counting,
+         * dictionary, SIMD network or radix sort from the range and the container's value
+         * statistics. Otherwise detail::adaptive_sort() returns early on a sorted range and
+         * uses its natural merge sort on a nearly sorted one; any other range is sorted with
+         * detail::string_sort() on cached prefixes for std::string indices, and std::sort
+         * with the comparator for everything else. Ranges large enough to split are sorted with a parallel
+         * merge sort on sort_threads() threads, arithmetic runs being merged by radix key
+         * so the result does not depend on the thread count.
+         */
+        void sort_snapshot_range(size_t first, size_t last) const{
+            slot_type* data = sorted_snapshot.data();
+            if constexpr (natural_order && !indirect_sort && detail::radix_traits<T>::enabled){
+                using traits = detail::radix_traits<T>;
+                auto less = [](const T& a, const T& b){ return traits::key(a) < traits::key(b); };
+                detail::parallel_merge_sort(data + first, data + last, less, sort_threads(), [this](T* from, T* to){
+                    detail::sort_arithmetic(from, to, stats);
+                });
+            }
+            else{
+                auto less = [this](const slot_type& a, const slot_type& b){ return slot_less(a, b); };
+                detail::parallel_merge_sort(data + first, data + last, less, sort_threads(), [this, &less](slot_type* from, slot_type* to){
+                    detail::adaptive_sort(from, to, less, [this, &less](slot_type* begin, slot_type* end){
+                        if constexpr (natural_order && indirect_sort && detail::is_byte_string<T>::value){
+                            detail::string_sort(begin, end, elements.data());
+                        }
+                        else{
+                            std::sort(begin, end, less);
+                        }
+                    });
+                });
+            }
+        }
+
+        /**
+         * @brief Put position k of the snapshot in its final sorted place
+         * @param k Position in ascending order
+         * @details The snapshot is sorted lazily from both ends. Positions [0, settled_low) and
+         * [settled_high, n) are final, and the unsorted middle is partitioned between them.
+         * A request inside the middle grows the nearer end: std::nth_element splits off the
+         * next chunk in O(m) and only that chunk is sorted. Chunks at least double the
+         * settled part of that end, so the first element of a scan costs O(n), the next ones
+         * amortized O(log n), and the whole middle is sorted once a chunk would cover half of it.
+         */
+        void settle_sorted_position(size_t k) const{
+            size_t low = settled_low, high = settled_high;
+            if(k < low || k >= high) return;
+            auto less = [this](const slot_type& a, const slot_type& b){ return slot_less(a, b); };
+            auto base = sorted_snapshot.begin();
+            bool from_front = k - low <= high - 1 - k;
+            size_t needed = from_front ? k - low + 1 : high - k;
+            size_t done = from_front ? low : sorted_snapshot.size() - high;
+            size_t chunk = std::max(std::max(needed, done), lazy_sort_chunk);
+            if(chunk * 2 >= high - low){
+                sort_snapshot_range(low, high);
+                settled_high.store(sorted_snapshot.size(), std::memory_order_release);
+                settled_low.store(sorted_snapshot.size(), std::memory_order_release);
+            }
+            else if(from_front){
+                std::nth_element(base + low, base + low + chunk, base + high, less);
+                sort_snapshot_range(low, low + chunk);
+                settled_low.store(low + chunk, std::memory_order_release);
+            }
+            else{
+                std::nth_element(base + low, base + high - chunk, base + high, less);
+                sort_snapshot_range(high - chunk, high);
+                settled_high.store(high - chunk, std::memory_order_release);
+            }
+        }
+
+        /**
+         * @brief Append the elements added since the last refresh to the sorted snapshot, unsorted
+         * @details Skips the elements removed lazily in the meantime.
+         */
+        void append_to_snapshot() const{
+            size_t n = elements.size();
+            if constexpr (!indirect_sort){
+                if(dead_count == 0){
+                    sorted_snapshot.insert(sorted_snapshot.end(), elements.begin() + sorted_count, elements.end());
+                    sorted_count = n;
+                    return;
+                }
+            }
+            sorted_snapshot.reserve(sorted_snapshot.size() + (n - sorted_count));
+            for(size_t i = sorted_count; i < n; ++i) if(!is_dead(i)) sorted_snapshot.push_back(make_slot(i));
+            sorted_count = n;
+        }
+
+        /**
+         * @brief Bring the sorted snapshot up to date with the elements
+         * @details If the elements were added in ascending order (no descents), the snapshot
+         * is their insertion order and no comparison is made. Otherwise, elements appended
+         * since the last call form an unsorted tail. If the snapshot is fully sorted, only
+         * that tail is sorted and then merged into it, so k appends cost O(k log k + n)
+         * instead of a full O(n log n) sort. Otherwise the new entries join the unsorted
+         * middle, which is sorted at once if the elements are nearly sorted (the natural
+         * merge sort is close to linear there and the lazy partitioning would scramble it)
+         * and settled lazily by the iterators otherwise. Elements removed lazily are left
+         * out of the snapshot, but stay in the storage until a non-const call compacts it.
+         */
+        void refresh_sorted_snapshot() const{
+            std::lock_guard<detail::cache_mutex> lock(snapshot_mutex);
+            drop_dead_from_snapshot();
+            if(sorted_count == elements.size()) return;
+            if(descents == 0){
+                if(!snapshot_settled()){
+                    sorted_snapshot.clear();
+                    sorted_count = 0;
+                }
+                append_to_snapshot();
+                settled_low = settled_high = sorted_snapshot.size();
+                return;
+            }
+            size_t merged = sorted_snapshot.size();
+            append_to_snapshot();
+            if(merged == 0 || !snapshot_settled()){
+                settled_low = 0;
+                settled_high = sorted_snapshot.size();
+                if(descents <= sorted_snapshot.size() / detail::natural_merge_divisor){
+                    sort_snapshot_range(0, sorted_snapshot.size());
+                    settled_low = settled_high = sorted_snapshot.size();
+                }
+                return;
+            }
+            if(merged == sorted_snapshot.size()) return;
+            auto less = [this](const slot_type& a, const slot_type& b){ return slot_less(a, b); };
+            auto middle = sorted_snapshot.begin() + merged;
+            sort_snapshot_range(merged, sorted_snapshot.size());
+            if(less(*middle, *(middle - 1))){
+                std::inplace_merge(sorted_snapshot.begin(), middle, sorted_snapshot.end(), less);
+            }
+            settled_low = settled_high = sorted_snapshot.size();
+        }
+
+        /// Returned by the target lookups of erase_targets() for an element that is not removed
+        static constexpr size_t no_target = static_cast<size_t>(-1);
+
+        /**
+         * @brief Erase the snapshot entries that refer to removed elements
+         * @param first Position of the first snapshot entry that may be erased
+         * @param last Position past the last snapshot entry that may be erased
+         * @param erased_slot Tells whether a snapshot entry is to be erased
+         * @param shift_indices Whether the elements of the erased entries are about to be compacted away
+         * @return Number of snapshot entries erased
+         * @details Must run before the elements are compacted. The range is compacted in one
+         * stable pass, which keeps the lazily sorted ends valid. In indirect mode with
+         * shift_indices, the remaining indices are shifted down past the erased positions so
+         * they stay valid once the elements are compacted.
+         */
+        template<typename ErasedSlot>
+        size_t erase_from_sorted_snapshot(size_t first, size_t last, const ErasedSlot& erased_slot, bool shift_indices = true) const{
+            std::vector<size_t> gone;
+            size_t below_low = 0, below_high = 0, low = settled_low, high = settled_high;
+            auto begin = sorted_snapshot.begin() + first, end = sorted_snapshot.begin() + last;
+            auto kept = begin;
+            for(auto it = begin; it != end; ++it){
+                if(erased_slot(*it)){
+                    size_t position = it - sorted_snapshot.begin();
+                    below_low += position < low;
+                    below_high += position < high;
+                    if constexpr (indirect_sort) if(shift_indices) gone.push_back(slot_index(*it));
+                    continue;
+                }
+                if(kept != it) *kept = std::move(*it);
+                ++kept;
+            }
+            size_t erased = end - kept;
+            if(erased == 0) return 0;
+            sorted_snapshot.erase(kept, end);
+            settled_low = low - below_low;
+            settled_high = high - below_high;
+            if constexpr (indirect_sort){
+                if(!gone.empty()){
+                    std::sort(gone.begin(), gone.end());
+                    for(slot_type& slot : sorted_snapshot){
+                        size_t& index = slot_index(slot);
+                        index -= std::lower_bound(gone.begin(), gone.end(), index) - gone.begin();
+                    }
+                }
+            }
+            return erased;
+        }
+
+        /**
+         * @brief Remove every element that is a removal target, in one stable compaction pass
+         * @param target_of Maps an element and its key to the index of its target, or no_target
+         * @param hits Number of elements removed per target, incremented by this call
+         * @param snapshot_first Position of the first snapshot entry that may hold a target
+         * @param snapshot_last Position past the last snapshot entry that may hold a target
+         * @return Number of elements removed
+         * @details Moves the cached keys along with the elements, recounts the descents unless
+         * the elements were already in ascending order (removal cannot break that) and
+         * rebuilds the value statistics. The sorted snapshot is kept valid by erasing the
+         * targets from it; if that does not account for every removed element (operator== and
+         * the ordering disagree for T), the snapshot is dropped instead. Nothing changes if no
+         * element is a target. The hash index is left to the caller.
+         */
+        template<typename TargetOf>
+        size_t erase_targets(const TargetOf& target_of, std::vector<size_t>& hits, size_t snapshot_first, size_t snapshot_last){
+            size_t removed_sorted = erase_from_sorted_snapshot(snapshot_first, snapshot_last,
+                [this, &target_of](const slot_type& slot){ return target_of(slot_value(slot), slot_key(slot)) != no_target; });
+            bool recount = descents != 0;
+            size_t kept = 0, removed_prefix = 0, kept_descents = 0;
+            auto kept_stats = stats;
+            if constexpr (tracks_stats) kept_stats.clear();
+            for(size_t i = 0; i < elements.size(); ++i){
+                size_t target = target_of(elements[i], key_at(i));
+                if(target != no_target){
+                    ++hits[target];
+                    removed_prefix += i < sorted_count;
+                    continue;
+                }
+                if(kept != i){
+                    elements[kept] = std::move(elements[i]);
+                    if constexpr (keyed_sort) cached_keys[kept] = std::move(cached_keys[i]);
+                }
+                if(recount && kept > 0 && key_less(key_at(kept), key_at(kept - 1))) ++kept_descents;
+                if constexpr (tracks_stats) kept_stats.add(elements[kept]);
+                ++kept;
+            }
+            size_t removed = elements.size() - kept;
+            if(removed == 0) return 0;
+            elements.erase(elements.begin() + kept, elements.end());
+            if constexpr (keyed_sort) cached_keys.erase(cached_keys.begin() + kept, cached_keys.end());
+            descents = kept_descents;
+            stats = kept_stats;
+            if(removed_sorted == removed_prefix) sorted_count -= removed_prefix;
+            else reset_sorted_snapshot();
+            ++generation;
+            return removed;
+        }
+
+        /**
+         * @brief Remove every instance of an arithmetic value with the vectorized compaction kernel
+         * @param element The value to remove
+         * @param snapshot_first Position of the first snapshot entry that may hold the value
+         * @param snapshot_last Position past the last snapshot entry that may hold the value
+         * @return Number of elements removed
+         * @details Same effect as erase_targets() for a single value, but the elements are
+         * compacted with detail::compress_not_equal(), and the value statistics are not
+         * rebuilt: the old ones describe a superset of the remaining elements, which is all
+         * the sort strategy selection needs.
+         */
+        size_t erase_value(const T& element, size_t snapshot_first, size_t snapshot_last){
+            size_t removed_sorted = erase_from_sorted_snapshot(snapshot_first, snapshot_last,
+                [&element](const slot_type& slot){ return slot == element; });
+            T* data = elements.data();
+            size_t n = elements.size();
+            size_t kept_prefix = detail::compress_not_equal(data, sorted_count, element);
+            size_t kept_tail = detail::compress_not_equal(data + sorted_count, n - sorted_count, element);
+            size_t removed = n - kept_prefix - kept_tail;
+            if(removed == 0) return 0;
+            std::copy(data + sorted_count, data + sorted_count + kept_tail, data + kept_prefix);
+            elements.resize(kept_prefix + kept_tail);
+            if(descents != 0){
+                descents = 0;
+                for(size_t i = 1; i < elements.size(); ++i) descents += key_less(elements[i], elements[i - 1]);
+            }
+            if(elements.empty()) stats.clear();
+            else stats.count -= removed;
+            if(removed_sorted == sorted_count - kept_prefix) sorted_count = kept_prefix;
+            else reset_sorted_snapshot();
+            ++generation;
+            return removed;
+        }
+
+        /**
+         * @brief Remove every instance of a value right away
+         * @param element The value to remove
+         * @return Number of instances removed
+         */
+        size_t erase_all(const T& element){
+            size_t first = 0, last = sorted_snapshot.size();
+            if(snapshot_settled()){
+                const key_type& key = element_key(element);
+                auto slot_before = [this](const slot_type& slot, const key_type& k){ return key_less(slot_key(slot), k); };
+                auto slot_after = [this](const key_type& k, const slot_type& slot){ return key_less(k, slot_key(slot)); };
+                auto begin = sorted_snapshot.begin();
+                auto low = std::lower_bound(begin, sorted_snapshot.end(), key, slot_before);
+                auto high = std::upper_bound(low, sorted_snapshot.end(), key, slot_after);
+                if constexpr (radix_ordered && std::is_floating_point<T>::value){
+                    // Both zeros equal the element, and the radix order keeps -0.0 right before +0.0
+                    if(element == T(0)){
+                        low = std::lower_bound(begin, sorted_snapshot.end(), -T(0), slot_before);
+                        high = std::upper_bound(low, sorted_snapshot.end(), T(0), slot_after);
+                    }
+                }
+                first = low - begin;
+                last = high - begin;
+            }
+            if constexpr (tracks_stats && !indirect_sort){
+                return erase_value(element, first, last);
+            }
+            else{
+                std::vector<size_t> hits(1, 0);
+                auto target_of = [&element](const T& value, const key_type&){ return value == element ? size_t(0) : no_target; };
+                return erase_targets(target_of, hits, first, last);
+            }
+        }
+
+        /**
+         * @brief Check whether an element was removed but not compacted away yet
+         * @param i Index of the element
+         * @return True if the element's tombstone is set
+         */
+        bool is_dead(size_t i) const{
+            return dead_count != 0 && i / 64 < dead_slots.size() && ((dead_slots[i / 64] >> (i % 64)) & 1) != 0;
+        }
+
+        /**
+         * @brief Get the storage index of a live element
+         * @param k Position of the element among the live ones, in insertion order
+         * @return Index of the k-th live element in elements
+         * @details O(1) without tombstones. Otherwise a binary search over live_before_word
+         * finds the bitmap word, and the k-th clear bit is taken from it; elements added after
+         * the last removal lie past the bitmap and are never dead.
+         */
+        size_t live_position(size_t k) const{
+            if(dead_count == 0) return k;
+            size_t words = dead_slots.size();
+            if(k >= live_before_word[words]) return k + dead_count;
+            size_t word = std::upper_bound(live_before_word.begin(), live_before_word.end(), k) - live_before_word.begin() - 1;
+            std::uint64_t live = ~dead_slots[word];
+            for(size_t skip = k - live_before_word[word]; skip > 0; --skip) live &= live - 1;
+            return word * 64 + static_cast<size_t>(__builtin_ctzll(live));
+        }
+
+        /**
+         * @brief Count the dead elements stored before an index
+         * @param i Index into elements
+         * @return Number of tombstones set below i
+         */
+        size_t dead_before(size_t i) const{
+            size_t word = i / 64;
+            if(word >= dead_slots.size()) return dead_count;
+            std::uint64_t below = (std::uint64_t(1) << (i % 64)) - 1;
+            return word * 64 - live_before_word[word] + static_cast<size_t>(__builtin_popcountll(dead_slots[word] & below));
+        }
+
+        /**
+         * @brief Mark every live instance of a value as removed instead of compacting
+         * @param element The value to remove
+         * @return Number of instances marked
+         * @details Nothing moves. In indirect mode with a fully sorted snapshot, the
+         * instances merged into the snapshot are found by binary search over the value's run
+         * and only the tail added since is scanned; otherwise every element is compared. In
+         * direct mode the snapshot holds copies without positions, so this is always O(n).
+         * The live counts per bitmap word are then rebuilt in O(n/64) for the insertion-order
+         * scans. Compacts once the dead fraction passes the threshold.
+         */
+        size_t mark_removed(const T& element){
+            if(dead_slots.size() * 64 < elements.size()) dead_slots.resize((elements.size() + 63) / 64, 0);
+            size_t marked = 0;
+            auto mark = [&](size_t i){
+                if(elements[i] == element && !is_dead(i)){
+                    dead_slots[i / 64] |= std::uint64_t(1) << (i % 64);
+                    ++marked;
+                    ++dead_count;
+                }
+            };
+            size_t scan_from = 0;
+            if constexpr (indirect_sort){
+                if(snapshot_settled()){
+                    const key_type& key = element_key(element);
+                    auto low = std::lower_bound(sorted_snapshot.begin(), sorted_snapshot.end(), key,
+                        [this](const slot_type& slot, const key_type& k){ return key_less(slot_key(slot), k); });
+                    for(auto it = low; it != sorted_snapshot.end() && !key_less(key, slot_key(*it)); ++it) mark(slot_index(*it));
+                    scan_from = sorted_count;
+                }
+            }
+            for(size_t i = scan_from; i < elements.size(); ++i) mark(i);
+            live_before_word.resize(dead_slots.size() + 1);
+            live_before_word[0] = 0;
+            for(size_t word = 0; word < dead_slots.size(); ++word){
+                live_before_word[word + 1] = live_before_word[word] + 64 - static_cast<size_t>(__builtin_popcountll(dead_slots[word]));
+            }
+            if(marked == 0) return 0;
+            if constexpr (!indirect_sort) undropped_removals.push_back(element);
+            ++generation;
+            if(static_cast<double>(dead_count) > compaction_ratio * static_cast<double>(elements.size())) fold_tombstones();
+            return marked;
+        }
+
+        /**
+         * @brief Drop the snapshot entries of the elements removed lazily since the last call
+         * @details Leaves the storage alone, so the ordered scans can run on a const container
+         * with tombstones. In indirect mode the entries are found by their indices. In direct
+         * mode an entry is dropped when it equals a value removed since the last call
+         * (remove() marks every instance of a value, and a later add() of it only reaches the
+         * snapshot after this call); without std::hash<T> the snapshot is dropped instead.
+         */
+        void drop_dead_from_snapshot() const{
+            if(snapshot_dead == dead_count) return;
+            if constexpr (indirect_sort){
+                erase_from_sorted_snapshot(0, sorted_snapshot.size(),
+                    [this](slot_type& slot){ return is_dead(slot_index(slot)); }, false);
+            }
+            else if constexpr (hash_indexable){
+                std::unordered_map<T, size_t> gone;
+                for(const T& value : undropped_removals) gone.emplace(value, 0);
+                erase_from_sorted_snapshot(0, sorted_snapshot.size(),
+                    [&gone](const slot_type& slot){ return gone.find(slot) != gone.end(); }, false);
+                undropped_removals.clear();
+            }
+            else{
+                reset_sorted_snapshot();
+            }
+            snapshot_dead = dead_count;
+        }
+
+        /**
+         * @brief Compact away the elements marked as removed
+         * @details One stable pass over the elements (and their cached keys) and one over the
+         * sorted snapshot, which drops the entries of removed elements and keeps the lazily
+         * sorted ends valid; in indirect mode the remaining indices are shifted down by the
+         * number of dead elements before them. The descents are recounted over the live
+         * elements. Only non-const calls compact (compact(), the threshold, and the other
+         * removals and settings that need a dense storage); iterators are unaffected because
+         * every iterator created before the removals is already stale.
+         */
+        void fold_tombstones(){
+            if(dead_count == 0) return;
+            drop_dead_from_snapshot();
+            size_t dead_prefix = 0;
+            for(size_t i = 0; i < sorted_count; ++i) dead_prefix += is_dead(i);
+            bool snapshot_kept = sorted_snapshot.size() == sorted_count - dead_prefix;
+            if constexpr (indirect_sort){
+                if(snapshot_kept){
+                    for(slot_type& slot : sorted_snapshot){
+                        size_t& index = slot_index(slot);
+                        index -= dead_before(index);
+                    }
+                }
+            }
+            bool recount = descents != 0;
+            size_t kept = 0, kept_descents = 0;
+            for(size_t i = 0; i < elements.size(); ++i){
+                if(is_dead(i)) continue;
+                if(kept != i){
+                    elements[kept] = std::move(elements[i]);
+                    if constexpr (keyed_sort) cached_keys[kept] = std::move(cached_keys[i]);
+                }
+                if(recount && kept > 0 && key_less(key_at(kept), key_at(kept - 1))) ++kept_descents;
+                ++kept;
+            }
+            elements.erase(elements.begin() + kept, elements.end());
+            if constexpr (keyed_sort) cached_keys.erase(cached_keys.begin() + kept, cached_keys.end());
+            descents = kept_descents;
+            if(snapshot_kept) sorted_count -= dead_prefix;
+            else reset_sorted_snapshot();
+            dead_slots.clear();
+            live_before_word.clear();
+            dead_count = 0;
+            snapshot_dead = 0;
+        }
+
+        /**
+         * @brief Bring the bookkeeping up to date with elements appended in bulk
+         * @param old_size Number of elements before the append
+         * @details Caches the keys of the new elements, then counts them in the hash index,
+         * then updates the descents and statistics in one pass. If a projection or the hash
+         * index throws, the appended elements are taken out again.
+         */
+        void index_appended(size_t old_size){
+            size_t n = elements.size();
+            if(n == old_size) return;
+            if constexpr (keyed_sort){
+                try{
+                    cached_keys.reserve(n);
+                    for(size_t i = old_size; i < n; ++i) cached_keys.push_back(key_type(std::invoke(projection, elements[i])));
+                }
+                catch(...){
+                    cached_keys.erase(cached_keys.begin() + old_size, cached_keys.end());
+                    elements.erase(elements.begin() + old_size, elements.end());
+                    throw;
+                }
+            }
+            if constexpr (hash_indexable){
+                if(hash_indexed){
+                    size_t i = old_size;
+                    try{
+                        for(; i < n; ++i) ++value_counts[elements[i]];
+                    }
+                    catch(...){
+                        for(size_t j = old_size; j < i; ++j){
+                            auto counted = value_counts.find(elements[j]);
+                            if(--counted->second == 0) value_counts.erase(counted);
+                        }
+                        if constexpr (keyed_sort) cached_keys.erase(cached_keys.begin() + old_size, cached_keys.end());
+                        elements.erase(elements.begin() + old_size, elements.end());
+                        throw;
+                    }
+                }
+            }
+            for(size_t i = old_size; i < n; ++i){
+                if(i > 0 && key_less(key_at(i), key_at(i - 1))) ++descents;
+                if constexpr (tracks_stats) stats.add(elements[i]);
+            }
+            ++generation;
+        }
+
+        /// Moving a container cannot throw when its comparator, projection and hash index move without throwing
+        static constexpr bool nothrow_movable = std::is_nothrow_move_constructible<Compare>::value
+            && std::is_nothrow_move_assignable<Compare>::value
+            && std::is_nothrow_move_constructible<Projection>::value
+            && std::is_nothrow_move_assignable<Projection>::value
+            && std::is_nothrow_move_constructible<value_counts_type>::value
+            && std::is_nothrow_move_assignable<value_counts_type>::value;
+
+        /**
+         * @brief Leave a moved-from container empty and consistent
+         * @details Keeps the settings (threads, hash index, compaction threshold) and marks
+         * every iterator into the container as stale.
+         */
+        void reset_moved_from() noexcept{
+            elements.clear();
+            cached_keys.clear();
+            descents = 0;
+            if constexpr (tracks_stats) stats.clear();
+            if constexpr (hash_indexable) value_counts.clear();
+            dead_slots.clear();
+            dead_count = 0;
+            live_before_word.clear();
+            if constexpr (!indirect_sort) undropped_removals.clear();
+            snapshot_dead = 0;
+            sorted_snapshot.clear();
+            sorted_count = settled_low = settled_high = 0;
+            ++generation;
+        }
+
+        /**
+         * @brief Copy the sorted snapshot of another container
+         * @param other The container to copy from, whose scans may be sorting it on other threads
+         * @details Holds other's snapshot_mutex, so no lazy sort of other runs during the copy.
+         */
+        void copy_snapshot(const MyContainer& other){
+            std::lock_guard<detail::cache_mutex> lock(other.snapshot_mutex);
+            undropped_removals = other.undropped_removals;
+            snapshot_dead = other.snapshot_dead;
+            sorted_snapshot = other.sorted_snapshot;
+            sorted_count = other.sorted_count;
+            settled_low = other.settled_low.load();
+            settled_high = other.settled_high.load();
+        }
+
+        /**
+         * @brief Drop the sorted snapshot so the next ordered scan rebuilds it from scratch
+         */
+        void reset_sorted_snapshot() const{
+            sorted_snapshot.clear();
+            sorted_count = 0;
+            settled_low = settled_high = 0;
+            if constexpr (!indirect_sort) undropped_removals.clear();
+            snapshot_dead = dead_count;
+        }
+
+        /**
+         * @brief Verify that an iterator is still valid for this container
+         * @param iterator_generation The generation recorded by the iterator
+         * @throws std::runtime_error in debug mode if the container was modified since
+         */
+        void check_generation(size_t iterator_generation) const{
+#if MYCONTAINER_DEBUG_ITERATORS
+            if(iterator_generation != generation) throw std::runtime_error("Iterator used after the container was modified");
+#else
+            (void)iterator_generation;
+#endif
+        }
 
     public:
         /**
@@ -31,19 +1309,128 @@ namespace ex4{
          */
         MyContainer() = default;
 
+        /**
+         * @brief Constructor with a comparator and a projection
+         * @param comp Strict weak ordering on keys that defines the ascending order
+         * @param proj Maps an element to its key
+         */
+        explicit MyContainer(Compare comp, Projection proj = Projection())
+            : compare(std::move(comp)), projection(std::move(proj)){}
+
+        /**
+         * @brief Constructor from a list of elements
+         * @param values The elements, added in order
+         * @param comp Strict weak ordering on keys that defines the ascending order
+         * @param proj Maps an element to its key
+         */
+        MyContainer(std::initializer_list<T> values, Compare comp = Compare(), Projection proj = Projection())
+            : compare(std::move(comp)), projection(std::move(proj)){
+            add_range(values.begin(), values.end());
+        }
+
+        /**
+         * @brief Constructor from an iterator range
+         * @param first Iterator to the first element to add
+         * @param last Iterator past the last element to add
+         * @param comp Strict weak ordering on keys that defines the ascending order
+         * @param proj Maps an element to its key
+         */
+        template<typename InputIt, typename = typename std::iterator_traits<InputIt>::iterator_category>
+        MyContainer(InputIt first, InputIt last, Compare comp = Compare(), Projection proj = Projection())
+            : compare(std::move(comp)), projection(std::move(proj)){
+            add_range(first, last);
+        }
+
         /**
          * @brief Copy constructor
          * @param other The MyContainer to copy from
          */
-        MyContainer(const MyContainer& other) : elements(other.elements){}
-        
+        MyContainer(const MyContainer& other)
+            : elements(other.elements), generation(other.generation), sort_thread_count(other.sort_thread_count),
+              compare(other.compare), projection(other.projection),
+              cached_keys(other.cached_keys), descents(other.descents), stats(other.stats),
+              value_counts(other.value_counts), hash_indexed(other.hash_indexed),
+              compaction_ratio(other.compaction_ratio), dead_slots(other.dead_slots), dead_count(other.dead_count),
+              live_before_word(other.live_before_word){
+            copy_snapshot(other);
+        }
+        
+        /**
+         * @brief Assignment operator
+         * @param other The MyContainer to assign from
+         * @return Reference to this MyContainer
+         */
+        MyContainer& operator=(const MyContainer& other){
+            if(this != &other){
+                elements = other.elements;
+                sort_thread_count = other.sort_thread_count;
+                compare = other.compare;
+                projection = other.projection;
+                cached_keys = other.cached_keys;
+                descents = other.descents;
+                stats = other.stats;
+                value_counts = other.value_counts;
+                hash_indexed = other.hash_indexed;
+                compaction_ratio = other.compaction_ratio;
+                dead_slots = other.dead_slots;
+                dead_count = other.dead_count;
+                live_before_word = other.live_before_word;
+                copy_snapshot(other);
+                ++generation;
+            }
+            return *this;
+        }
+
+        /**
+         * @brief Move constructor
+         * @param other The MyContainer to move from, left empty
+         * @details Takes over the storage, the sorted snapshot and the indexes without copying
+         * any element. Iterators into other become stale.
+         */
+        MyContainer(MyContainer&& other) noexcept(nothrow_movable)
+            : elements(std::move(other.elements)), generation(other.generation), sort_thread_count(other.sort_thread_count),
+              compare(std::move(other.compare)), projection(std::move(other.projection)),
+              cached_keys(std::move(other.cached_keys)), descents(other.descents), stats(other.stats),
+              value_counts(std::move(other.value_counts)), hash_indexed(other.hash_indexed),
+              compaction_ratio(other.compaction_ratio), dead_slots(std::move(other.dead_slots)), dead_count(other.dead_count),
+              live_before_word(std::move(other.live_before_word)), undropped_removals(std::move(other.undropped_removals)),
+              snapshot_dead(other.snapshot_dead),
+              sorted_snapshot(std::move(other.sorted_snapshot)), sorted_count(other.sorted_count),
+              settled_low(other.settled_low.load()), settled_high(other.settled_high.load()){
+            other.reset_moved_from();
+        }
+
         /**
-         * @brief Assignment operator
-         * @param other The MyContainer to assign from
+         * @brief Move assignment operator
+         * @param other The MyContainer to move from, left empty
          * @return Reference to this MyContainer
+         * @details Takes over the storage, the sorted snapshot and the indexes without copying
+         * any element. Iterators into either container become stale.
          */
-        MyContainer& operator=(const MyContainer& other){
-            if(this != &other) elements = other.elements;
+        MyContainer& operator=(MyContainer&& other) noexcept(nothrow_movable){
+            if(this != &other){
+                elements = std::move(other.elements);
+                sort_thread_count = other.sort_thread_count;
+                compare = std::move(other.compare);
+                projection = std::move(other.projection);
+                cached_keys = std::move(other.cached_keys);
+                descents = other.descents;
+                stats = other.stats;
+                value_counts = std::move(other.value_counts);
+                hash_indexed = other.hash_indexed;
+                compaction_ratio = other.compaction_ratio;
+                dead_slots = std::move(other.dead_slots);
+                dead_count = other.dead_count;
+                live_before_word = std::move(other.live_before_word);
+                undropped_removals = std::move(other.undropped_removals);
+                snapshot_dead = other.snapshot_dead;
+                sorted_snapshot = std::move(other.sorted_snapshot);
+                sorted_count = other.sorted_count;
+                settled_low = other.settled_low.load();
+                settled_high = other.settled_high.load();
+                ++generation;
+                other.reset_moved_from();
+            }
             return *this;
         }
 
@@ -56,29 +1443,360 @@ namespace ex4{
          * @brief Add an element to the container
          * @param element The element to add
          */
-        void add(const T& element){
-            elements.push_back(element);
+        void add(const T& element){ emplace(element); }
+
+        /**
+         * @brief Add an element to the container, moving it in
+         * @param element The element to add, left in a moved-from state
+         */
+        void add(T&& element){ emplace(std::move(element)); }
+
+        /**
+         * @brief Construct an element in place at the end of the container
+         * @param args Arguments forwarded to the constructor of T
+         * @return Reference to the new element
+         * @details The only insertion path that never copies or moves T, so it also works for
+         * types that are neither copyable nor cheap to move. Its key and statistics are taken
+         * from the constructed element.
+         */
+        template<typename... Args>
+        const T& emplace(Args&&... args){
+            elements.emplace_back(std::forward<Args>(args)...);
+            const T& element = elements.back();
+            if constexpr (keyed_sort){
+                try{ cached_keys.push_back(key_type(std::invoke(projection, element))); }
+                catch(...){ elements.pop_back(); throw; }
+            }
+            if constexpr (hash_indexable){
+                if(hash_indexed){
+                    try{ ++value_counts[element]; }
+                    catch(...){
+                        elements.pop_back();
+                        if constexpr (keyed_sort) cached_keys.pop_back();
+                        throw;
+                    }
+                }
+            }
+            size_t n = elements.size();
+            if(n > 1 && key_less(key_at(n - 1), key_at(n - 2))) ++descents;
+            if constexpr (tracks_stats) stats.add(element);
+            ++generation;
+            return element;
+        }
+
+        /**
+         * @brief Add the elements of an iterator range, in order
+         * @param first Iterator to the first element to add
+         * @param last Iterator past the last element to add
+         * @details The elements are appended with a single vector insertion, which allocates
+         * once for forward iterators and copies trivially copyable elements with memmove.
+         * Keys, hash index entries, descents and statistics are then computed in one pass
+         * over the appended block, which the next ordered scan sorts as a whole and merges
+         * into the sorted snapshot. For forward iterators the storage is grown before the
+         * first element is read, so the range may come from this container itself (such as
+         * c.add_range(c.in_order())) without being read across a reallocation. If reading
+         * or copying an element throws, the elements already appended are removed again.
+         */
+        template<typename InputIt, typename = typename std::iterator_traits<InputIt>::iterator_category>
+        void add_range(InputIt first, InputIt last){
+            size_t old_size = elements.size();
+            using category = typename std::iterator_traits<InputIt>::iterator_category;
+            if constexpr (std::is_base_of<std::forward_iterator_tag, category>::value){
+                size_t needed = old_size + static_cast<size_t>(std::distance(first, last));
+                if(needed > elements.capacity()) elements.reserve(std::max(needed, 2 * elements.capacity()));
+            }
+            try{
+                elements.insert(elements.end(), first, last);
+            }
+            catch(...){
+                // Input iterators are appended one by one, so a failure can leave a partial block
+                elements.erase(elements.begin() + old_size, elements.end());
+                throw;
+            }
+            index_appended(old_size);
+        }
+
+        /**
+         * @brief Add the elements of a range, in order
+         * @param values Any range usable with std::begin and std::end
+         * @details The elements are moved out of an rvalue range that owns them, such as a
+         * temporary std::vector, and copied from anything else, including rvalue views and
+         * spans (see detail::owns_elements).
+         */
+        template<typename Range>
+        void add_range(Range&& values){
+            using std::begin;
+            using std::end;
+            if constexpr (detail::owns_elements<Range>::value) add_range(std::make_move_iterator(begin(values)), std::make_move_iterator(end(values)));
+            else add_range(begin(values), end(values));
         }
 
+        /**
+         * @brief Add a list of elements, in order
+         * @param values The elements to add
+         */
+        void add_range(std::initializer_list<T> values){ add_range(values.begin(), values.end()); }
+
         /**
          * @brief Remove an element from the container
          * @param element The element to remove
          * @throws std::runtime_error if the element is not found in the container
-         * @details Uses the erase-remove idiom to efficiently remove all instances 
-         * of the specified element from the container
+         * @details Same as try_remove(), but a missing element is an error.
          */
         void remove(const T& element){
-            if(std::find(elements.begin(), elements.end(), element) == elements.end()){
+            if(try_remove(element) == 0){
                 throw std::runtime_error("Element was not found in the container");
             }
-            elements.erase(std::remove(elements.begin(), elements.end(), element),elements.end());
+        }
+
+        /**
+         * @brief Remove an element from the container if it is present
+         * @param element The element to remove
+         * @return Number of instances removed, 0 if the element was not found
+         * @details Removes all instances of the specified element in a single stable
+         * compaction pass, vectorized for arithmetic elements under the natural order. The
+         * sorted snapshot is kept valid: on a fully sorted snapshot the value's run is located
+         * by binary search and erased in place instead of re-sorting everything. With the hash
+         * index enabled, a missing element is rejected in O(1) without touching the elements
+         * or the snapshot. With lazy removal enabled, the instances are only marked as
+         * removed (see set_compaction_threshold).
+         */
+        size_t try_remove(const T& element){
+            if constexpr (hash_indexable){
+                if(hash_indexed && value_counts.find(element) == value_counts.end()) return 0;
+            }
+            size_t removed = compaction_ratio > 0 ? mark_removed(element) : erase_all(element);
+            if constexpr (hash_indexable){
+                if(hash_indexed && removed != 0) value_counts.erase(element);
+            }
+            return removed;
+        }
+
+        /**
+         * @brief Remove every element that satisfies a predicate
+         * @param pred Callable invoked as pred(element), must give the same answer for equal elements
+         * @return Number of elements removed
+         * @details One stable compaction pass over the elements and the sorted snapshot. An
+         * ex4::equals predicate is forwarded to try_remove() and gets its vectorized pass.
+         */
+        template<typename Predicate>
+        size_t remove_if(Predicate pred){
+            if constexpr (std::is_same<typename std::decay<Predicate>::type, equals<T>>::value){
+                return try_remove(pred.value);
+            }
+            else{
+                fold_tombstones();
+                std::vector<size_t> hits(1, 0);
+                auto target_of = [&pred](const T& value, const key_type&){ return pred(value) ? size_t(0) : no_target; };
+                size_t removed = erase_targets(target_of, hits, 0, sorted_snapshot.size());
+                if constexpr (hash_indexable){
+                    if(hash_indexed && removed != 0){
+                        for(auto it = value_counts.begin(); it != value_counts.end();){
+                            if(pred(it->first)) it = value_counts.erase(it);
+                            else ++it;
+                        }
+                    }
+                }
+                return removed;
+            }
+        }
+
+        /**
+         * @brief Remove every instance of several elements at once
+         * @param values Range of the elements to remove
+         * @return Number of instances removed for each entry of values, in the same order
+         * @details Unlike remove(), a missing element is not an error: its count is 0. The
+         * targets are put in a hash map and the container is compacted in a single pass, so
+         * removing m values costs O(n + m) instead of m separate passes. When std::hash<T>
+         * is not available, the targets are sorted by key instead and each element is looked
+         * up by binary search, operator== picking its target among those with an equivalent
+         * key: O((n + m) log m), growing towards O(n * m) when many targets share a key. A
+         * value listed twice gets the same count at both positions.
+         */
+        template<typename Range>
+        std::vector<size_t> remove_all(const Range& values){
+            fold_tombstones();
+            std::vector<size_t> target_ids;
+            std::vector<size_t> hits;
+            if constexpr (hash_indexable){
+                std::unordered_map<T, size_t> targets;
+                for(const auto& value : values){
+                    auto inserted = targets.emplace(value, targets.size());
+                    target_ids.push_back(inserted.first->second);
+                }
+                hits.assign(targets.size(), 0);
+                bool any_present = true;
+                if(hash_indexed){
+                    any_present = false;
+                    for(const auto& target : targets) any_present = any_present || value_counts.count(target.first) != 0;
+                }
+                if(any_present){
+                    erase_targets([&targets](const T& value, const key_type&){
+                        auto found = targets.find(value);
+                        return found == targets.end() ? no_target : found->second;
+                    }, hits, 0, sorted_snapshot.size());
+                }
+                if(hash_indexed){
+                    for(const auto& target : targets) if(hits[target.second] != 0) value_counts.erase(target.first);
+                }
+            }
+            else{
+                std::vector<std::pair<key_type, T>> listed;
+                for(const auto& value : values) listed.emplace_back(element_key(value), value);
+                std::vector<size_t> order(listed.size());
+                for(size_t i = 0; i < order.size(); ++i) order[i] = i;
+                std::stable_sort(order.begin(), order.end(),
+                    [this, &listed](size_t a, size_t b){ return key_less(listed[a].first, listed[b].first); });
+                std::vector<std::pair<key_type, T>> targets;
+                target_ids.resize(listed.size());
+                size_t key_first = 0;
+                for(size_t position : order){
+                    std::pair<key_type, T>& entry = listed[position];
+                    if(key_first != targets.size() && key_less(targets[key_first].first, entry.first)) key_first = targets.size();
+                    size_t id = key_first;
+                    while(id != targets.size() && !(targets[id].second == entry.second)) ++id;
+                    if(id == targets.size()) targets.push_back(std::move(entry));
+                    target_ids[position] = id;
+                }
+                hits.assign(targets.size(), 0);
+                erase_targets([this, &targets](const T& value, const key_type& key){
+                    auto found = std::lower_bound(targets.begin(), targets.end(), key,
+                        [this](const std::pair<key_type, T>& target, const key_type& k){ return key_less(target.first, k); });
+                    for(; found != targets.end() && !key_less(key, found->first); ++found){
+                        if(found->second == value) return static_cast<size_t>(found - targets.begin());
+                    }
+                    return no_target;
+                }, hits, 0, sorted_snapshot.size());
+            }
+            for(size_t& id : target_ids) id = hits[id];
+            return target_ids;
+        }
+
+        /**
+         * @brief Remove every instance of several elements at once
+         * @param values The elements to remove
+         * @return Number of instances removed for each entry of values, in the same order
+         */
+        std::vector<size_t> remove_all(std::initializer_list<T> values){
+            return remove_all<std::initializer_list<T>>(values);
         }
 
         /**
          * @brief Get the number of elements in the container
-         * @return The number of elements as size_t
+         * @return The number of elements as size_t, not counting removed ones awaiting compaction
          */
-        size_t size() const{return elements.size();}
+        size_t size() const{return elements.size() - dead_count;}
+
+        /**
+         * @brief Check whether the elements were added in ascending order
+         * @return True if no element orders before the one added just before it
+         * @details O(1): add() and remove() keep a count of such descents. When it is zero the
+         * ordered iterators use the insertion order directly and never sort. While lazily
+         * removed elements await compaction it may report false for elements that are sorted.
+         */
+        bool is_sorted() const{ return descents == 0; }
+
+        /**
+         * @brief Check whether the container holds an element
+         * @param element The element to look for
+         * @return True if some element compares equal to element
+         * @details O(1) on average with the hash index enabled, a linear scan otherwise that
+         * skips the elements removed lazily.
+         */
+        bool contains(const T& element) const{
+            if constexpr (hash_indexable){
+                if(hash_indexed) return value_counts.find(element) != value_counts.end();
+            }
+            if(dead_count == 0) return std::find(elements.begin(), elements.end(), element) != elements.end();
+            for(size_t i = 0; i < elements.size(); ++i){
+                if(elements[i] == element && !is_dead(i)) return true;
+            }
+            return false;
+        }
+
+        /**
+         * @brief Enable or disable the hash index
+         * @param enabled Whether add() should maintain a hash map from each value to its number of instances
+         * @details Enabling builds the index from the current elements in one pass. The index
+         * answers contains() and the "not found" check of remove() in O(1), at the cost of a
+         * hash insertion in every add() and memory per distinct value. Requires std::hash<T>,
+         * consistent with operator== on T, and a copyable T.
+         */
+        void set_hash_index(bool enabled){
+            static_assert(hash_indexable, "The hash index requires std::hash<T> and a copyable T");
+            if constexpr (hash_indexable){
+                if(enabled && !hash_indexed){
+                    fold_tombstones();
+                    std::unordered_map<T, size_t> counts;
+                    for(const T& element : elements) ++counts[element];
+                    value_counts = std::move(counts);
+                }
+                else if(!enabled){
+                    value_counts = std::unordered_map<T, size_t>();
+                }
+                hash_indexed = enabled;
+            }
+        }
+
+        /**
+         * @brief Check whether the hash index is enabled
+         * @return True if add() maintains the hash index (see set_hash_index)
+         */
+        bool has_hash_index() const{ return hash_indexed; }
+
+        /**
+         * @brief Enable or disable lazy removal
+         * @param threshold Fraction of dead elements, in [0, 1], above which removal compacts; 0 removes eagerly
+         * @throws std::invalid_argument if threshold is outside [0, 1]
+         * @details With a positive threshold, remove() and try_remove() only mark the removed
+         * elements in a bitmap, so a burst of k removals moves the elements once instead of k
+         * times. Finding the instances is cheap only in indirect mode (see sort_by_index):
+         * with a fully sorted snapshot they come from a binary search, and only the elements
+         * added since the last ordered scan are compared. In direct mode (int, double and
+         * other small trivially copyable types) each removal still compares every element,
+         * so k removals cost O(k*n) comparisons, without the moves. The marked elements are
+         * compacted away in one pass when their fraction passes the threshold, when compact()
+         * is called, or before remove_all(), remove_if() and set_hash_index(true). Until
+         * then the scans, contains() and operator<< skip them: const functions never compact.
+         * Setting 0 compacts right away.
+         */
+        void set_compaction_threshold(double threshold){
+            if(!(threshold >= 0 && threshold <= 1)) throw std::invalid_argument("Compaction threshold must be in [0, 1]");
+            compaction_ratio = threshold;
+            if(threshold == 0) fold_tombstones();
+        }
+
+        /**
+         * @brief Get the lazy removal threshold
+         * @return The fraction set by set_compaction_threshold(), 0 if removal is eager
+         */
+        double compaction_threshold() const{ return compaction_ratio; }
+
+        /**
+         * @brief Compact away the elements marked by lazy removal
+         * @details Does nothing if no element awaits compaction. The elements keep their order.
+         */
+        void compact(){ fold_tombstones(); }
+
+        /**
+         * @brief Get the number of elements marked by lazy removal and not compacted away yet
+         * @return Number of dead slots in the storage
+         */
+        size_t tombstones() const{ return dead_count; }
+
+        /**
+         * @brief Set how many threads this container uses to sort its snapshot
+         * @param threads Number of threads, or 0 to follow default_sort_threads()
+         * @details Only snapshots large enough to give every thread a sizable chunk are sorted
+         * in parallel; smaller ones are always sorted on the calling thread.
+         */
+        void set_sort_threads(size_t threads){ sort_thread_count = threads; }
+
+        /**
+         * @brief Get how many threads this container uses to sort its snapshot
+         * @return The container's own setting, or default_sort_threads() if it has none
+         */
+        size_t sort_threads() const{ return sort_thread_count != 0 ? sort_thread_count : default_sort_threads(); }
 
         /**
          * @brief Stream insertion operator for MyContainer
@@ -87,527 +1805,336 @@ namespace ex4{
          * @return Reference to the output stream
          * @details Formats the container as a comma-separated list of elements enclosed in square brackets
          */
-        friend std::ostream& operator<<(std::ostream& os, const MyContainer<T>& container){
+        friend std::ostream& operator<<(std::ostream& os, const MyContainer& container){
             os<< "[" ;
-            if (container.elements.empty()) {
+            if (container.size() == 0) {
                 os << "]";
                 return os;
             }
+            bool first = true;
             for (size_t i = 0; i < container.elements.size(); ++i) {
-                os << container.elements[i];
-                if (i < container.elements.size() - 1) {
+                if (container.is_dead(i)) continue;
+                if (!first) {
                     os << ", ";
                 }
+                os << container.elements[i];
+                first = false;
             }
             os << "]";
             return os;
         }
 
+        /// Past-the-end marker returned by every end_*() function
+        using Sentinel = OrderSentinel<MyContainer>;
+
+        /// Random-access machinery shared by all six iterator types (see ex4::IndexIterator)
+        template<typename Derived>
+        using IndexIterator = ex4::IndexIterator<MyContainer, Derived>;
+
         /**
          * @brief Iterator that traverses elements in their original order
+         * @details A view over the owner's storage: it holds only a position and never copies
+         * elements. Position k maps to the k-th live element, so elements removed lazily are
+         * skipped; because of them the iterator is random-access but not contiguous.
          */
-        class OrderIterator{
-
-            private:
-            std::vector<T> _elements;      ///< Copy of container elements
-            size_t current_index;          ///< Current position in the iteration
-            const MyContainer<T>* owner;   ///< Pointer to the container being iterated
-
-            public:
-            /**
-             * @brief Constructor for OrderIterator
-             * @param elements Vector of elements to iterate
-             * @param index Starting position for iteration
-             * @param container Pointer to the owner container
-             */
-            OrderIterator(const std::vector<T>& elements, size_t index, const MyContainer<T>* container)
-                : _elements(elements), current_index(index), owner(container){}
-
-            /**
-             * @brief Dereference operator
-             * @return Reference to the current element
-             * @throws std::out_of_range if iterator is out of bounds
-             */
-            const T& operator*() const{
-                if(current_index >= _elements.size()) throw std::out_of_range("Iterator out of bounds");
-                return _elements[current_index];
-            }
+        class OrderIterator : public IndexIterator<OrderIterator>{
 
-            /**
-             * @brief Pre-increment operator
-             * @return Reference to this iterator after advancement
-             */
-            OrderIterator& operator++(){++current_index; return *this; }
+            using Base = IndexIterator<OrderIterator>;
+            friend Base;
 
             /**
-             * @brief Post-increment operator
-             * @return Copy of the iterator before advancement
+             * @brief Element at a position of the original order
+             * @param k Position in the iteration
+             * @return Reference to the element inside the owner container
              */
-            OrderIterator operator++(int){
-                OrderIterator tmp = *this;
-                ++current_index;
-                return tmp;
-            }
+            const T& element_at(size_t k) const { return this->owner->elements[this->owner->live_position(k)]; }
 
             /**
-             * @brief Equality comparison operator
-             * @param other The iterator to compare with
-             * @return True if both iterators belong to the same container and point to the same index
+             * @brief Number of positions in the original order
+             * @return The size of the owner container
              */
-            bool operator==(const OrderIterator& other) const { 
-                return owner == other.owner && current_index == other.current_index; 
-            }
+            size_t order_size() const { return this->owner->size(); }
 
-            /**
-             * @brief Inequality comparison operator
-             * @param other The iterator to compare with
-             * @return True if iterators are not equal
-             */
-            bool operator!=(const OrderIterator& other) const { return !(*this == other); }
+            public:
+            using Base::Base;
         };
 
         /**
          * @brief Get an iterator to the beginning of the container in original order
          * @return OrderIterator pointing to the first element
          */
-        OrderIterator begin_order() { return OrderIterator(elements, 0, this); }
-        
+        OrderIterator begin_order() const {
+            return OrderIterator(0, this);
+        }
+
         /**
-         * @brief Get an iterator to the end of the container in original order
-         * @return OrderIterator pointing past the last element
+         * @brief Get the end sentinel of the container in original order
+         * @return Sentinel that compares equal to an iterator past the last element
          */
-        OrderIterator end_order() { return OrderIterator(elements, elements.size(), this); }
+        Sentinel end_order() const { return Sentinel(this); }
 
         /**
          * @brief Iterator that traverses elements in reverse order
+         * @details A view over the owner's storage: position k maps to live element n-1-k
          */
-        class ReverseOrderIterator{
-
-            private:
-            std::vector<T> reverse_elements; ///< Reversed copy of container elements
-            size_t current_index;           ///< Current position in the iteration
-            const MyContainer<T>* owner;    ///< Pointer to the container being iterated
-
-            public:
-            /**
-             * @brief Constructor for ReverseOrderIterator
-             * @param elements Vector of elements to iterate in reverse
-             * @param index Starting position for iteration
-             * @param container Pointer to the owner container
-             */
-            ReverseOrderIterator(const std::vector<T>& elements, size_t index, const MyContainer<T>* container)
-                : reverse_elements(elements), current_index(index), owner(container){
-                    std::reverse(reverse_elements.begin(), reverse_elements.end());
-                }
-
-            /**
-             * @brief Dereference operator
-             * @return Reference to the current element
-             * @throws std::out_of_range if iterator is out of bounds
-             */
-            const T& operator*() const{
-                if(current_index >= reverse_elements.size()) throw std::out_of_range("Iterator out of bounds");
-                return reverse_elements[current_index];
-            }
+        class ReverseOrderIterator : public IndexIterator<ReverseOrderIterator>{
 
-            /**
-             * @brief Pre-increment operator
-             * @return Reference to this iterator after advancement
-             */
-            ReverseOrderIterator& operator++(){++current_index; return *this; }
+            using Base = IndexIterator<ReverseOrderIterator>;
+            friend Base;
 
             /**
-             * @brief Post-increment operator
-             * @return Copy of the iterator before advancement
+             * @brief Element at a position of the reverse order
+             * @param k Position in the iteration
+             * @return Reference to the element inside the owner container
              */
-            ReverseOrderIterator operator++(int){
-                ReverseOrderIterator tmp = *this;
-                ++current_index;
-                return tmp;
-            }
+            const T& element_at(size_t k) const { return this->owner->elements[this->owner->live_position(this->owner->size() - 1 - k)]; }
 
             /**
-             * @brief Equality comparison operator
-             * @param other The iterator to compare with
-             * @return True if both iterators belong to the same container and point to the same index
+             * @brief Number of positions in the reverse order
+             * @return The size of the owner container
              */
-            bool operator==(const ReverseOrderIterator& other) const { 
-                return owner == other.owner && current_index == other.current_index; 
-            }
+            size_t order_size() const { return this->owner->size(); }
 
-            /**
-             * @brief Inequality comparison operator
-             * @param other The iterator to compare with
-             * @return True if iterators are not equal
-             */
-            bool operator!=(const ReverseOrderIterator& other) const { return !(*this == other); }
+            public:
+            using Base::Base;
         };
 
         /**
          * @brief Get an iterator to the beginning of the container in reverse order
          * @return ReverseOrderIterator pointing to the first element (last in original order)
          */
-        ReverseOrderIterator begin_reverse_order() { return ReverseOrderIterator(elements, 0, this); }
-        
+        ReverseOrderIterator begin_reverse_order() const {
+            return ReverseOrderIterator(0, this);
+        }
+
         /**
-         * @brief Get an iterator to the end of the container in reverse order
-         * @return ReverseOrderIterator pointing past the last element
+         * @brief Get the end sentinel of the container in reverse order
+         * @return Sentinel that compares equal to an iterator past the last element
          */
-        ReverseOrderIterator end_reverse_order() { return ReverseOrderIterator(elements, elements.size(), this); }
+        Sentinel end_reverse_order() const { return Sentinel(this); }
 
         /**
          * @brief Iterator that traverses elements in ascending order
+         * @details Reads the owner's cached sorted snapshot, which begin_ascending_order() refreshes.
+         * The snapshot is sorted lazily as positions are dereferenced, so reading the smallest
+         * few elements does not pay for a full sort.
          */
-        class AscendingIterator{
-
-            private:
-            std::vector<T> sorted_elements; ///< Sorted copy of container elements
-            size_t current_index;          ///< Current position in the iteration
-            const MyContainer<T>* owner;   ///< Pointer to the container being iterated
-
-            public:
-            /**
-             * @brief Constructor for AscendingIterator
-             * @param elements Vector of elements to iterate in ascending order
-             * @param index Starting position for iteration
-             * @param container Pointer to the owner container
-             */
-            AscendingIterator(const std::vector<T>& elements, size_t index, const MyContainer<T>* container)
-                : sorted_elements(elements), current_index(index), owner(container){
-                std::sort(sorted_elements.begin(), sorted_elements.end());
-            }
-
-            /**
-             * @brief Dereference operator
-             * @return Reference to the current element
-             * @throws std::out_of_range if iterator is out of bounds
-             */
-            const T& operator*() const{
-                if(current_index >= sorted_elements.size()) throw std::out_of_range("Iterator out of bounds");
-                return sorted_elements[current_index];
-            }
-
-            /**
-             * @brief Pre-increment operator
-             * @return Reference to this iterator after advancement
-             */
-            AscendingIterator& operator++(){++current_index; return *this; }
+        class AscendingIterator : public IndexIterator<AscendingIterator>{
 
-            /**
-             * @brief Post-increment operator
-             * @return Copy of the iterator before advancement
-             */
-            AscendingIterator operator++(int){
-                AscendingIterator tmp = *this;
-                ++current_index;
-                return tmp;
-            }
+            using Base = IndexIterator<AscendingIterator>;
+            friend Base;
 
             /**
-             * @brief Equality comparison operator
-             * @param other The iterator to compare with
-             * @return True if both iterators belong to the same container and point to the same index
+             * @brief Element at a position of the ascending order
+             * @param k Position in the iteration
+             * @return Reference to the element inside the sorted snapshot (or the owner in indirect mode)
              */
-            bool operator==(const AscendingIterator& other) const { 
-                return owner == other.owner && current_index == other.current_index; 
-            }
+            const T& element_at(size_t k) const { return this->owner->sorted_at(k); }
 
             /**
-             * @brief Inequality comparison operator
-             * @param other The iterator to compare with
-             * @return True if iterators are not equal
+             * @brief Number of positions in the ascending order
+             * @return The size of the sorted snapshot
              */
-            bool operator!=(const AscendingIterator& other) const { return !(*this == other); }
+            size_t order_size() const { return this->owner->sorted_snapshot.size(); }
 
+            public:
+            using Base::Base;
         };
 
         /**
          * @brief Get an iterator to the beginning of the container in ascending order
          * @return AscendingIterator pointing to the smallest element
          */
-        AscendingIterator begin_ascending_order() { return AscendingIterator(elements, 0, this); }
-        
+        AscendingIterator begin_ascending_order() const {
+            refresh_sorted_snapshot();
+            return AscendingIterator(0, this);
+        }
+
         /**
-         * @brief Get an iterator to the end of the container in ascending order
-         * @return AscendingIterator pointing past the last element
+         * @brief Get the end sentinel of the container in ascending order
+         * @return Sentinel that compares equal to an iterator past the last element
          */
-        AscendingIterator end_ascending_order() { return AscendingIterator(elements, elements.size(), this); }
+        Sentinel end_ascending_order() const { return Sentinel(this); }
 
         /**
          * @brief Iterator that traverses elements in descending order
+         * @details Walks the owner's cached sorted snapshot from the back, so it shares
+         * the snapshot with AscendingIterator instead of sorting in reverse
          */
-        class DescendingOrder {
-
-            private:
-            std::vector<T> reverse_sorted_elements; ///< Sorted copy of container elements in descending order
-            size_t current_index;                  ///< Current position in the iteration
-            const MyContainer<T>* owner;           ///< Pointer to the container being iterated
-
-            public:
-            /**
-             * @brief Constructor for DescendingOrder iterator
-             * @param elements Vector of elements to iterate in descending order
-             * @param index Starting position for iteration
-             * @param container Pointer to the owner container
-             */
-            DescendingOrder(const std::vector<T>& elements, size_t index, const MyContainer<T>* container)
-                : reverse_sorted_elements(elements), current_index(index), owner(container){
-                std::sort(reverse_sorted_elements.begin(), reverse_sorted_elements.end(), std::greater<T>());
-            }
-
-            /**
-             * @brief Dereference operator
-             * @return Reference to the current element
-             * @throws std::out_of_range if iterator is out of bounds
-             */
-            const T& operator*() const{
-                if(current_index >= reverse_sorted_elements.size()) throw std::out_of_range("Iterator out of bounds");
-                return reverse_sorted_elements[current_index];
-            }
+        class DescendingOrder : public IndexIterator<DescendingOrder>{
 
-            /**
-             * @brief Pre-increment operator
-             * @return Reference to this iterator after advancement
-             */
-            DescendingOrder& operator++(){++current_index; return *this; }
-
-            /**
-             * @brief Post-increment operator
-             * @return Copy of the iterator before advancement
-             */
-            DescendingOrder operator++(int){
-                DescendingOrder tmp = *this;
-                ++current_index;
-                return tmp;
-            }
+            using Base = IndexIterator<DescendingOrder>;
+            friend Base;
 
             /**
-             * @brief Equality comparison operator
-             * @param other The iterator to compare with
-             * @return True if both iterators belong to the same container and point to the same index
+             * @brief Element at a position of the descending order
+             * @param k Position in the iteration
+             * @return Reference to the element inside the sorted snapshot (or the owner in indirect mode)
              */
-            bool operator==(const DescendingOrder& other) const { 
-                return owner == other.owner && current_index == other.current_index; 
-            }
+            const T& element_at(size_t k) const { return this->owner->sorted_at(this->owner->sorted_snapshot.size() - 1 - k); }
 
             /**
-             * @brief Inequality comparison operator
-             * @param other The iterator to compare with
-             * @return True if iterators are not equal
+             * @brief Number of positions in the descending order
+             * @return The size of the sorted snapshot
              */
-            bool operator!=(const DescendingOrder& other) const { return !(*this == other); }
+            size_t order_size() const { return this->owner->sorted_snapshot.size(); }
 
+            public:
+            using Base::Base;
         };
 
         /**
          * @brief Get an iterator to the beginning of the container in descending order
          * @return DescendingOrder pointing to the largest element
          */
-        DescendingOrder begin_descending_order() { return DescendingOrder(elements, 0, this); }
-        
+        DescendingOrder begin_descending_order() const {
+            refresh_sorted_snapshot();
+            return DescendingOrder(0, this);
+        }
+
         /**
-         * @brief Get an iterator to the end of the container in descending order
-         * @return DescendingOrder pointing past the last element
+         * @brief Get the end sentinel of the container in descending order
+         * @return Sentinel that compares equal to an iterator past the last element
          */
-        DescendingOrder end_descending_order() { return DescendingOrder(elements, elements.size(), this); }
+        Sentinel end_descending_order() const { return Sentinel(this); }
 
         /**
          * @brief Iterator that traverses elements in a side-cross pattern
-         * @details Traverses from both ends toward the middle: smallest element, 
+         * @details Traverses from both ends toward the middle: smallest element,
          * largest element, second smallest, second largest, etc.
+         * Position k maps to sorted position k/2 when k is even and n-1-k/2 when k is odd,
+         * so the iterator reads the owner's sorted snapshot directly and needs no buffer.
          */
-        class SideCrossIterator {
-            private:
-            std::vector<T> sorted_elements;       ///< Sorted copy of container elements
-            std::vector<T> side_cross_order;      ///< Elements arranged in side-cross order
-            size_t current_index;                ///< Current position in the iteration
-            const MyContainer<T>* owner;         ///< Pointer to the container being iterated
-
-            public:
-            /**
-             * @brief Constructor for SideCrossIterator
-             * @param elements Vector of elements to iterate
-             * @param index Starting position for iteration
-             * @param container Pointer to the owner container
-             * @details Arranges elements in side-cross pattern: smallest, largest, 
-             * second smallest, second largest, etc.
-             */
-            SideCrossIterator(const std::vector<T>& elements, size_t index, const MyContainer<T>* container)
-                : sorted_elements(elements), current_index(index), owner(container) {
-                
-                if (elements.empty()) return;
-                
-                std::sort(sorted_elements.begin(), sorted_elements.end());
-
-                size_t left = 0, right = sorted_elements.size() - 1;
-                while (left <= right) {
-                    side_cross_order.push_back(sorted_elements[left++]);
-                    if (left <= right) {
-                        side_cross_order.push_back(sorted_elements[right--]);
-                    }
-                }
-            }
-
-            /**
-             * @brief Dereference operator
-             * @return Reference to the current element
-             * @throws std::out_of_range if iterator is out of bounds
-             */
-            const T& operator*() const {
-                if(current_index >= side_cross_order.size()) throw std::out_of_range("Iterator out of bounds");
-                return side_cross_order[current_index];
-            }
+        class SideCrossIterator : public IndexIterator<SideCrossIterator>{
 
-            /**
-             * @brief Pre-increment operator
-             * @return Reference to this iterator after advancement
-             */
-            SideCrossIterator& operator++() {
-                ++current_index;
-                return *this;
-            }
+            using Base = IndexIterator<SideCrossIterator>;
+            friend Base;
 
             /**
-             * @brief Post-increment operator
-             * @return Copy of the iterator before advancement
+             * @brief Element at a position of the side-cross order
+             * @param k Position in the iteration
+             * @return Reference to the element inside the sorted snapshot (or the owner in indirect mode)
              */
-            SideCrossIterator operator++(int) {
-                SideCrossIterator tmp = *this;
-                ++current_index;
-                return tmp;
+            const T& element_at(size_t k) const {
+                size_t n = this->owner->sorted_snapshot.size();
+                return this->owner->sorted_at(k % 2 == 0 ? k / 2 : n - 1 - k / 2);
             }
 
             /**
-             * @brief Equality comparison operator
-             * @param other The iterator to compare with
-             * @return True if both iterators belong to the same container and point to the same index
+             * @brief Number of positions in the side-cross order
+             * @return The size of the sorted snapshot
              */
-            bool operator==(const SideCrossIterator& other) const {
-                return owner == other.owner && current_index == other.current_index;
-            }
+            size_t order_size() const { return this->owner->sorted_snapshot.size(); }
 
-            /**
-             * @brief Inequality comparison operator
-             * @param other The iterator to compare with
-             * @return True if iterators are not equal
-             */
-            bool operator!=(const SideCrossIterator& other) const {
-                return !(*this == other);
-            }
+            public:
+            using Base::Base;
         };
 
         /**
          * @brief Get an iterator to the beginning of the container in side-cross order
          * @return SideCrossIterator pointing to the first element in side-cross order
          */
-        SideCrossIterator begin_side_cross_order() { return SideCrossIterator(elements, 0, this); }
-        
+        SideCrossIterator begin_side_cross_order() const {
+            refresh_sorted_snapshot();
+            return SideCrossIterator(0, this);
+        }
+
         /**
-         * @brief Get an iterator to the end of the container in side-cross order
-         * @return SideCrossIterator pointing past the last element
+         * @brief Get the end sentinel of the container in side-cross order
+         * @return Sentinel that compares equal to an iterator past the last element
          */
-        SideCrossIterator end_side_cross_order() { return SideCrossIterator(elements, elements.size(), this); }
+        Sentinel end_side_cross_order() const { return Sentinel(this); }
 
         /**
          * @brief Iterator that traverses elements from the middle outward
-         * @details Starts from the middle element and then alternates left and right
+         * @details Starts from the middle element and then alternates left and right.
+         * With mid = n/2, position k maps to mid - (k+1)/2 when k is odd and mid + k/2 when
+         * k is even, so the iterator reads the owner's storage directly and allocates nothing.
          */
-        class MiddleOutIterator {
-            private:
-            std::vector<T> middle_out_order;     ///< Elements arranged in middle-out order
-            size_t current_index;               ///< Current position in the iteration
-            const MyContainer<T>* owner;        ///< Pointer to the container being iterated
-
-            public:
-            /**
-             * @brief Constructor for MiddleOutIterator
-             * @param elements Vector of elements to iterate
-             * @param index Starting position for iteration
-             * @param container Pointer to the owner container
-             * @details Arranges elements in middle-out pattern starting from the middle element,
-             * then alternating left and right outward
-             */
-            MiddleOutIterator(const std::vector<T>& elements, size_t index, const MyContainer<T>* container)
-                : current_index(index), owner(container) {
-
-                if (elements.empty()) return;
-
-                size_t n = elements.size();
-                size_t mid = n / 2;
-
-                // Add the middle element
-                middle_out_order.push_back(elements[mid]);
+        class MiddleOutIterator : public IndexIterator<MiddleOutIterator>{
 
-                // Then scan alternately left and right, moving toward the edges
-                for (size_t offset = 1; offset <= mid; ++offset) {
-                    if (mid >= offset)
-                        middle_out_order.push_back(elements[mid - offset]);  // Left
-                    if (mid + offset < n)
-                        middle_out_order.push_back(elements[mid + offset]);  // Right
-                }
-            }
-
-            /**
-             * @brief Dereference operator
-             * @return Reference to the current element
-             * @throws std::out_of_range if iterator is out of bounds
-             */
-            const T& operator*() const {
-                if(current_index >= middle_out_order.size()) throw std::out_of_range("Iterator out of bounds");
-                return middle_out_order[current_index];
-            }
-
-            /**
-             * @brief Pre-increment operator
-             * @return Reference to this iterator after advancement
-             */
-            MiddleOutIterator& operator++() {
-                ++current_index;
-                return *this;
-            }
+            using Base = IndexIterator<MiddleOutIterator>;
+            friend Base;
 
             /**
-             * @brief Post-increment operator
-             * @return Copy of the iterator before advancement
+             * @brief Element at a position of the middle-out order
+             * @param k Position in the iteration
+             * @return Reference to the element inside the owner container
              */
-            MiddleOutIterator operator++(int) {
-                MiddleOutIterator tmp = *this;
-                ++current_index;
-                return tmp;
+            const T& element_at(size_t k) const {
+                size_t mid = this->owner->size() / 2;
+                return this->owner->elements[this->owner->live_position(k % 2 == 1 ? mid - (k + 1) / 2 : mid + k / 2)];
             }
 
             /**
-             * @brief Equality comparison operator
-             * @param other The iterator to compare with
-             * @return True if both iterators belong to the same container and point to the same index
+             * @brief Number of positions in the middle-out order
+             * @return The size of the owner container
              */
-            bool operator==(const MiddleOutIterator& other) const {
-                return owner == other.owner && current_index == other.current_index;
-            }
+            size_t order_size() const { return this->owner->size(); }
 
-            /**
-             * @brief Inequality comparison operator
-             * @param other The iterator to compare with
-             * @return True if iterators are not equal
-             */
-            bool operator!=(const MiddleOutIterator& other) const {
-                return !(*this == other);
-            }
+            public:
+            using Base::Base;
         };
 
         /**
          * @brief Get an iterator to the beginning of the container in middle-out order
          * @return MiddleOutIterator pointing to the first element in middle-out order (middle element)
          */
-        MiddleOutIterator begin_middle_out_order() { return MiddleOutIterator(elements, 0, this); }
-        
+        MiddleOutIterator begin_middle_out_order() const {
+            return MiddleOutIterator(0, this);
+        }
+
+        /**
+         * @brief Get the end sentinel of the container in middle-out order
+         * @return Sentinel that compares equal to an iterator past the last element
+         */
+        Sentinel end_middle_out_order() const { return Sentinel(this); }
+
+        /**
+         * @brief View of the elements in original order
+         * @return OrderView over the insertion order
+         */
+        OrderView<OrderIterator> in_order() const { return OrderView<OrderIterator>(begin_order(), size()); }
+
         /**
-         * @brief Get an iterator to the end of the container in middle-out order
-         * @return MiddleOutIterator pointing past the last element
+         * @brief View of the elements in reverse order
+         * @return OrderView over the reverse insertion order
          */
-        MiddleOutIterator end_middle_out_order() { return MiddleOutIterator(elements, elements.size(), this); }
+        OrderView<ReverseOrderIterator> reversed() const { return OrderView<ReverseOrderIterator>(begin_reverse_order(), size()); }
+
+        /**
+         * @brief View of the elements in ascending order
+         * @return OrderView over the sorted snapshot
+         */
+        OrderView<AscendingIterator> ascending() const { return OrderView<AscendingIterator>(begin_ascending_order(), size()); }
+
+        /**
+         * @brief View of the elements in descending order
+         * @return OrderView over the sorted snapshot, walked from the back
+         */
+        OrderView<DescendingOrder> descending() const { return OrderView<DescendingOrder>(begin_descending_order(), size()); }
+
+        /**
+         * @brief View of the elements in side-cross order
+         * @return OrderView over the side-cross order
+         */
+        OrderView<SideCrossIterator> side_cross() const { return OrderView<SideCrossIterator>(begin_side_cross_order(), size()); }
+
+        /**
+         * @brief View of the elements in middle-out order
+         * @return OrderView over the middle-out order
+         */
+        OrderView<MiddleOutIterator> middle_out() const { return OrderView<MiddleOutIterator>(begin_middle_out_order(), size()); }
 
     };    
 }
 
+#if __cplusplus >= 202002L
+/**
+ * @brief An OrderView refers to its container, so iterators taken from a temporary view stay valid
+ */
+template<typename Iterator>
+inline constexpr bool std::ranges::enable_borrowed_range<ex4::OrderView<Iterator>> = true;
+#endif
+
 #endif
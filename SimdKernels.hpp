@@ -0,0 +1,531 @@
+//idocohen963@gmail.com
+
+/**
+ * @file SimdKernels.hpp
+ * @brief Vectorized building blocks for sorting unsigned keys, with runtime CPU dispatch
+ */
+#ifndef SIMDKERNELS_HPP
+#define SIMDKERNELS_HPP
+
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define EX4_X86_SIMD 1
+#include <immintrin.h>
+#else
+#define EX4_X86_SIMD 0
+#endif
+
+namespace ex4{
+
+    namespace detail{
+
+        /**
+         * @brief Instruction sets the kernels can use, in increasing order
+         */
+        enum class SimdLevel{
+            scalar = 0, ///< Portable C++ only
+            sse41 = 1,  ///< SSE4.1 (4 x 32-bit lanes)
+            avx2 = 2    ///< AVX2 (8 x 32-bit or 4 x 64-bit lanes)
+        };
+
+        /**
+         * @brief Detect the best instruction set supported by the running CPU
+         * @return The detected level, computed once
+         */
+        inline SimdLevel detected_simd_level(){
+#if EX4_X86_SIMD
+            static const SimdLevel level = []{
+                __builtin_cpu_init();
+                if(__builtin_cpu_supports("avx2")) return SimdLevel::avx2;
+                if(__builtin_cpu_supports("sse4.1")) return SimdLevel::sse41;
+                return SimdLevel::scalar;
+            }();
+            return level;
+#else
+            return SimdLevel::scalar;
+#endif
+        }
+
+        /**
+         * @brief Upper bound on the instruction set the kernels may use
+         * @return Reference to the limit (defaults to avx2, i.e. no limit)
+         */
+        inline std::atomic<int>& simd_level_limit(){
+            static std::atomic<int> limit(static_cast<int>(SimdLevel::avx2));
+            return limit;
+        }
+
+        /**
+         * @brief Restrict the kernels to an instruction set, e.g. to compare against the scalar path
+         * @param level The highest level the kernels may use
+         */
+        inline void set_simd_level_limit(SimdLevel level){ simd_level_limit().store(static_cast<int>(level)); }
+
+        /**
+         * @brief Instruction set the kernels use on this call
+         * @return The lower of the detected level and the configured limit
+         */
+        inline SimdLevel active_simd_level(){
+            return static_cast<SimdLevel>(std::min(static_cast<int>(detected_simd_level()), simd_level_limit().load()));
+        }
+
+        /// Keys are sorted in blocks of this many, so callers pad the key array to a multiple of it
+        constexpr size_t network_block = 64;
+
+        /**
+         * @brief Scalar compare-exchange
+         * @param a Receives the smaller key
+         * @param b Receives the larger key
+         */
+        template<typename K>
+        inline void compare_exchange(K& a, K& b){
+            K low = b < a ? b : a;
+            K high = b < a ? a : b;
+            a = low;
+            b = high;
+        }
+
+        /**
+         * @brief Sort every group of 8 keys with a 19-comparator sorting network (scalar path)
+         * @param keys Keys to sort in groups, count must be a multiple of 8
+         * @param n Number of keys
+         */
+        template<typename K>
+        void sort_runs_of_8_scalar(K* keys, size_t n){
+            for(K* r = keys; r != keys + n; r += 8){
+                compare_exchange(r[0], r[2]); compare_exchange(r[1], r[3]); compare_exchange(r[4], r[6]); compare_exchange(r[5], r[7]);
+                compare_exchange(r[0], r[4]); compare_exchange(r[1], r[5]); compare_exchange(r[2], r[6]); compare_exchange(r[3], r[7]);
+                compare_exchange(r[0], r[1]); compare_exchange(r[2], r[3]); compare_exchange(r[4], r[5]); compare_exchange(r[6], r[7]);
+                compare_exchange(r[2], r[4]); compare_exchange(r[3], r[5]);
+                compare_exchange(r[1], r[4]); compare_exchange(r[3], r[6]);
+                compare_exchange(r[1], r[2]); compare_exchange(r[3], r[4]); compare_exchange(r[5], r[6]);
+            }
+        }
+
+#if EX4_X86_SIMD
+        /**
+         * @brief Lane-wise compare-exchange of eight unsigned 32-bit keys
+         */
+        __attribute__((target("avx2"))) inline void compare_exchange_avx2(__m256i& a, __m256i& b){
+            __m256i low = _mm256_min_epu32(a, b);
+            b = _mm256_max_epu32(a, b);
+            a = low;
+        }
+
+        /**
+         * @brief Sort 32-bit keys into runs of 8 with AVX2
+         * @param keys Keys to sort in groups, count must be a multiple of 64
+         * @param n Number of keys
+         * @details Each block of 64 keys is loaded as 8 rows of 8 lanes; the sorting network
+         * runs on whole rows, which sorts every column, and an 8x8 transpose turns the
+         * sorted columns into 8 contiguous sorted runs.
+         */
+        __attribute__((target("avx2"))) inline void sort_runs_avx2(std::uint32_t* keys, size_t n){
+            for(std::uint32_t* block = keys; block != keys + n; block += 64){
+                __m256i r[8];
+                for(int i = 0; i < 8; ++i) r[i] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 8 * i));
+                compare_exchange_avx2(r[0], r[2]); compare_exchange_avx2(r[1], r[3]); compare_exchange_avx2(r[4], r[6]); compare_exchange_avx2(r[5], r[7]);
+                compare_exchange_avx2(r[0], r[4]); compare_exchange_avx2(r[1], r[5]); compare_exchange_avx2(r[2], r[6]); compare_exchange_avx2(r[3], r[7]);
+                compare_exchange_avx2(r[0], r[1]); compare_exchange_avx2(r[2], r[3]); compare_exchange_avx2(r[4], r[5]); compare_exchange_avx2(r[6], r[7]);
+                compare_exchange_avx2(r[2], r[4]); compare_exchange_avx2(r[3], r[5]);
+                compare_exchange_avx2(r[1], r[4]); compare_exchange_avx2(r[3], r[6]);
+                compare_exchange_avx2(r[1], r[2]); compare_exchange_avx2(r[3], r[4]); compare_exchange_avx2(r[5], r[6]);
+
+                __m256i t0 = _mm256_unpacklo_epi32(r[0], r[1]), t1 = _mm256_unpackhi_epi32(r[0], r[1]);
+                __m256i t2 = _mm256_unpacklo_epi32(r[2], r[3]), t3 = _mm256_unpackhi_epi32(r[2], r[3]);
+                __m256i t4 = _mm256_unpacklo_epi32(r[4], r[5]), t5 = _mm256_unpackhi_epi32(r[4], r[5]);
+                __m256i t6 = _mm256_unpacklo_epi32(r[6], r[7]), t7 = _mm256_unpackhi_epi32(r[6], r[7]);
+                __m256i u0 = _mm256_unpacklo_epi64(t0, t2), u1 = _mm256_unpackhi_epi64(t0, t2);
+                __m256i u2 = _mm256_unpacklo_epi64(t1, t3), u3 = _mm256_unpackhi_epi64(t1, t3);
+                __m256i u4 = _mm256_unpacklo_epi64(t4, t6), u5 = _mm256_unpackhi_epi64(t4, t6);
+                __m256i u6 = _mm256_unpacklo_epi64(t5, t7), u7 = _mm256_unpackhi_epi64(t5, t7);
+                r[0] = _mm256_permute2x128_si256(u0, u4, 0x20); r[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+                r[2] = _mm256_permute2x128_si256(u2, u6, 0x20); r[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+                r[4] = _mm256_permute2x128_si256(u0, u4, 0x31); r[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+                r[6] = _mm256_permute2x128_si256(u2, u6, 0x31); r[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+                for(int i = 0; i < 8; ++i) _mm256_storeu_si256(reinterpret_cast<__m256i*>(block + 8 * i), r[i]);
+            }
+        }
+
+        /**
+         * @brief Lane-wise compare-exchange of four unsigned 32-bit keys
+         */
+        __attribute__((target("sse4.1"))) inline void compare_exchange_sse41(__m128i& a, __m128i& b){
+            __m128i low = _mm_min_epu32(a, b);
+            b = _mm_max_epu32(a, b);
+            a = low;
+        }
+
+        /**
+         * @brief Sort 32-bit keys into runs of 4 with SSE4.1
+         * @param keys Keys to sort in groups, count must be a multiple of 16
+         * @param n Number of keys
+         * @details Same scheme as the AVX2 kernel on 4x4 blocks with a 5-comparator network.
+         */
+        __attribute__((target("sse4.1"))) inline void sort_runs_sse41(std::uint32_t* keys, size_t n){
+            for(std::uint32_t* block = keys; block != keys + n; block += 16){
+                __m128i r0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block));
+                __m128i r1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 4));
+                __m128i r2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 8));
+                __m128i r3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 12));
+                compare_exchange_sse41(r0, r1); compare_exchange_sse41(r2, r3);
+                compare_exchange_sse41(r0, r2); compare_exchange_sse41(r1, r3);
+                compare_exchange_sse41(r1, r2);
+
+                __m128i t0 = _mm_unpacklo_epi32(r0, r1), t1 = _mm_unpacklo_epi32(r2, r3);
+                __m128i t2 = _mm_unpackhi_epi32(r0, r1), t3 = _mm_unpackhi_epi32(r2, r3);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(block), _mm_unpacklo_epi64(t0, t1));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(block + 4), _mm_unpackhi_epi64(t0, t1));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(block + 8), _mm_unpacklo_epi64(t2, t3));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(block + 12), _mm_unpackhi_epi64(t2, t3));
+            }
+        }
+
+        /**
+         * @brief Lane-wise compare-exchange of four unsigned 64-bit keys stored with their top bit flipped
+         * @details AVX2 only compares signed 64-bit lanes, so the caller biases the keys.
+         */
+        __attribute__((target("avx2"))) inline void compare_exchange_avx2_64(__m256i& a, __m256i& b){
+            __m256i greater = _mm256_cmpgt_epi64(a, b);
+            __m256i low = _mm256_blendv_epi8(a, b, greater);
+            b = _mm256_blendv_epi8(b, a, greater);
+            a = low;
+        }
+
+        /**
+         * @brief Sort 64-bit keys into runs of 4 with AVX2
+         * @param keys Keys to sort in groups, count must be a multiple of 16
+         * @param n Number of keys
+         * @details 4x4 blocks: a 5-comparator network on rows followed by a transpose.
+         */
+        __attribute__((target("avx2"))) inline void sort_runs_avx2(std::uint64_t* keys, size_t n){
+            const __m256i bias = _mm256_set1_epi64x(static_cast<long long>(0x8000000000000000ULL));
+            for(std::uint64_t* block = keys; block != keys + n; block += 16){
+                __m256i r0 = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(block)), bias);
+                __m256i r1 = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 4)), bias);
+                __m256i r2 = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 8)), bias);
+                __m256i r3 = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 12)), bias);
+                compare_exchange_avx2_64(r0, r1); compare_exchange_avx2_64(r2, r3);
+                compare_exchange_avx2_64(r0, r2); compare_exchange_avx2_64(r1, r3);
+                compare_exchange_avx2_64(r1, r2);
+
+                __m256i t0 = _mm256_unpacklo_epi64(r0, r1), t1 = _mm256_unpackhi_epi64(r0, r1);
+                __m256i t2 = _mm256_unpacklo_epi64(r2, r3), t3 = _mm256_unpackhi_epi64(r2, r3);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(block), _mm256_xor_si256(_mm256_permute2x128_si256(t0, t2, 0x20), bias));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(block + 4), _mm256_xor_si256(_mm256_permute2x128_si256(t1, t3, 0x20), bias));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(block + 8), _mm256_xor_si256(_mm256_permute2x128_si256(t0, t2, 0x31), bias));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(block + 12), _mm256_xor_si256(_mm256_permute2x128_si256(t1, t3, 0x31), bias));
+            }
+        }
+
+        /**
+         * @brief Sort a bitonic sequence of eight 32-bit keys held in one register
+         */
+        __attribute__((target("avx2"))) inline __m256i bitonic_clean_avx2(__m256i v){
+            __m256i p = _mm256_permute2x128_si256(v, v, 1);
+            v = _mm256_blend_epi32(_mm256_min_epu32(v, p), _mm256_max_epu32(v, p), 0xF0);
+            p = _mm256_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+            v = _mm256_blend_epi32(_mm256_min_epu32(v, p), _mm256_max_epu32(v, p), 0xCC);
+            p = _mm256_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1));
+            return _mm256_blend_epi32(_mm256_min_epu32(v, p), _mm256_max_epu32(v, p), 0xAA);
+        }
+
+        /**
+         * @brief Merge two sorted registers of eight 32-bit keys
+         * @param lo Receives the eight smallest keys, sorted
+         * @param hi Receives the eight largest keys, sorted
+         */
+        __attribute__((target("avx2"))) inline void bitonic_merge_avx2(__m256i& lo, __m256i& hi){
+            hi = _mm256_permutevar8x32_epi32(hi, _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+            __m256i low = _mm256_min_epu32(lo, hi);
+            hi = bitonic_clean_avx2(_mm256_max_epu32(lo, hi));
+            lo = bitonic_clean_avx2(low);
+        }
+
+        /**
+         * @brief Sort a bitonic sequence of four biased 64-bit keys held in one register
+         */
+        __attribute__((target("avx2"))) inline __m256i bitonic_clean_avx2_64(__m256i v){
+            __m256i p = _mm256_permute4x64_epi64(v, _MM_SHUFFLE(1, 0, 3, 2));
+            __m256i greater = _mm256_cmpgt_epi64(v, p);
+            v = _mm256_blend_epi32(_mm256_blendv_epi8(v, p, greater), _mm256_blendv_epi8(p, v, greater), 0xF0);
+            p = _mm256_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+            greater = _mm256_cmpgt_epi64(v, p);
+            return _mm256_blend_epi32(_mm256_blendv_epi8(v, p, greater), _mm256_blendv_epi8(p, v, greater), 0xCC);
+        }
+
+        /**
+         * @brief Merge two sorted registers of four biased 64-bit keys
+         * @param lo Receives the four smallest keys, sorted
+         * @param hi Receives the four largest keys, sorted
+         */
+        __attribute__((target("avx2"))) inline void bitonic_merge_avx2_64(__m256i& lo, __m256i& hi){
+            hi = _mm256_permute4x64_epi64(hi, _MM_SHUFFLE(0, 1, 2, 3));
+            compare_exchange_avx2_64(lo, hi);
+            lo = bitonic_clean_avx2_64(lo);
+            hi = bitonic_clean_avx2_64(hi);
+        }
+
+        /**
+         * @brief Merge two adjacent sorted runs of 32-bit keys one register at a time
+         * @details Both run lengths must be non-zero multiples of 8. The register holding the
+         * largest keys seen so far is merged with the next block from whichever run has the
+         * smaller head, so only one branch is taken per eight keys.
+         */
+        __attribute__((target("avx2"))) inline void vector_merge_avx2(const std::uint32_t* a, const std::uint32_t* a_end,
+                                                                      const std::uint32_t* b, const std::uint32_t* b_end,
+                                                                      std::uint32_t* out){
+            __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a));
+            __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b));
+            a += 8;
+            b += 8;
+            bitonic_merge_avx2(lo, hi);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), lo);
+            out += 8;
+            while(a != a_end || b != b_end){
+                const std::uint32_t*& next = (b == b_end || (a != a_end && *a < *b)) ? a : b;
+                lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(next));
+                next += 8;
+                bitonic_merge_avx2(lo, hi);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), lo);
+                out += 8;
+            }
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), hi);
+        }
+
+        /**
+         * @brief Merge two adjacent sorted runs of 64-bit keys one register at a time
+         * @details Same scheme as the 32-bit merge with four keys per register; both run
+         * lengths must be non-zero multiples of 4.
+         */
+        __attribute__((target("avx2"))) inline void vector_merge_avx2(const std::uint64_t* a, const std::uint64_t* a_end,
+                                                                      const std::uint64_t* b, const std::uint64_t* b_end,
+                                                                      std::uint64_t* out){
+            const __m256i bias = _mm256_set1_epi64x(static_cast<long long>(0x8000000000000000ULL));
+            __m256i lo = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a)), bias);
+            __m256i hi = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(b)), bias);
+            a += 4;
+            b += 4;
+            bitonic_merge_avx2_64(lo, hi);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm256_xor_si256(lo, bias));
+            out += 4;
+            while(a != a_end || b != b_end){
+                const std::uint64_t*& next = (b == b_end || (a != a_end && *a < *b)) ? a : b;
+                lo = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(next)), bias);
+                next += 4;
+                bitonic_merge_avx2_64(lo, hi);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm256_xor_si256(lo, bias));
+                out += 4;
+            }
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm256_xor_si256(hi, bias));
+        }
+#endif
+
+        /**
+         * @brief Sort keys into short sorted runs with the best available kernel
+         * @param keys Keys to sort in groups, count must be a multiple of network_block
+         * @param n Number of keys
+         * @return Length of the sorted runs produced
+         */
+        template<typename K>
+        size_t sort_runs(K* keys, size_t n){
+#if EX4_X86_SIMD
+            SimdLevel level = active_simd_level();
+            if constexpr (sizeof(K) == 4){
+                if(level == SimdLevel::avx2){ sort_runs_avx2(reinterpret_cast<std::uint32_t*>(keys), n); return 8; }
+                if(level == SimdLevel::sse41){ sort_runs_sse41(reinterpret_cast<std::uint32_t*>(keys), n); return 4; }
+            }
+            else if constexpr (sizeof(K) == 8){
+                if(level == SimdLevel::avx2){ sort_runs_avx2(reinterpret_cast<std::uint64_t*>(keys), n); return 4; }
+            }
+#endif
+            sort_runs_of_8_scalar(keys, n);
+            return 8;
+        }
+
+        /**
+         * @brief Merge two adjacent sorted runs without data-dependent branches
+         * @param a First run
+         * @param a_end End of the first run
+         * @param b Second run
+         * @param b_end End of the second run
+         * @param out Destination for the merged keys
+         */
+        template<typename K>
+        void branchless_merge(const K* a, const K* a_end, const K* b, const K* b_end, K* out){
+            while(a != a_end && b != b_end){
+                bool take_b = *b < *a;
+                *out++ = take_b ? *b : *a;
+                a += !take_b;
+                b += take_b;
+            }
+            out = std::copy(a, a_end, out);
+            std::copy(b, b_end, out);
+        }
+
+        /**
+         * @brief Merge two adjacent sorted runs with the AVX2 kernel when allowed
+         * @param vectorized Whether the AVX2 merge may be used
+         */
+        template<typename K>
+        void merge_runs(const K* a, const K* a_end, const K* b, const K* b_end, K* out, bool vectorized){
+#if EX4_X86_SIMD
+            if constexpr (sizeof(K) == 4 || sizeof(K) == 8){
+                using lane_type = typename std::conditional<sizeof(K) == 4, std::uint32_t, std::uint64_t>::type;
+                if(vectorized){
+                    vector_merge_avx2(reinterpret_cast<const lane_type*>(a), reinterpret_cast<const lane_type*>(a_end),
+                                      reinterpret_cast<const lane_type*>(b), reinterpret_cast<const lane_type*>(b_end),
+                                      reinterpret_cast<lane_type*>(out));
+                    return;
+                }
+            }
+#endif
+            (void)vectorized;
+            branchless_merge(a, a_end, b, b_end, out);
+        }
+
+        /**
+         * @brief Sort unsigned keys with a sorting network followed by bottom-up merging
+         * @param keys Keys to sort, count must be a multiple of network_block
+         * @param n Number of keys
+         * @details The network and merge phases use SIMD when the CPU supports it; the result
+         * is the same on every path because the keys are totally ordered integers.
+         */
+        template<typename K>
+        void network_sort_keys(K* keys, size_t n){
+            size_t run = sort_runs(keys, n);
+            if(run >= n) return;
+            bool vectorized = active_simd_level() == SimdLevel::avx2;
+            std::vector<K> buffer(n);
+            K* src = keys;
+            K* dst = buffer.data();
+            for(; run < n; run *= 2){
+                for(size_t start = 0; start < n; start += 2 * run){
+                    size_t middle = std::min(start + run, n);
+                    size_t end = std::min(start + 2 * run, n);
+                    if(middle == end) std::copy(src + start, src + end, dst + start);
+                    else merge_runs(src + start, src + middle, src + middle, src + end, dst + start, vectorized);
+                }
+                std::swap(src, dst);
+            }
+            if(src != keys) std::copy(src, src + n, keys);
+        }
+
+#if EX4_X86_SIMD
+        /**
+         * @brief Lane permutations that pack the kept lanes of a vector to its front
+         * @details Entry m of lanes_32 lists, in order, the 32-bit lanes whose bit is set in m;
+         * entry m of lanes_64 does the same for 64-bit lanes, as pairs of 32-bit lane indices.
+         */
+        struct compress_table{
+            std::uint8_t lanes_32[256][8];
+            std::int32_t lanes_64[16][8];
+
+            constexpr compress_table() : lanes_32(), lanes_64(){
+                for(int mask = 0; mask < 256; ++mask){
+                    int out = 0;
+                    for(int lane = 0; lane < 8; ++lane) if(mask & (1 << lane)) lanes_32[mask][out++] = static_cast<std::uint8_t>(lane);
+                }
+                for(int mask = 0; mask < 16; ++mask){
+                    int out = 0;
+                    for(int lane = 0; lane < 4; ++lane){
+                        if(mask & (1 << lane)){
+                            lanes_64[mask][out++] = 2 * lane;
+                            lanes_64[mask][out++] = 2 * lane + 1;
+                        }
+                    }
+                }
+            }
+        };
+
+        /**
+         * @brief Drop every element equal to value, keeping the others in order (AVX2 path)
+         * @param data Elements, compacted in place
+         * @param n Number of elements
+         * @param value The value to drop
+         * @return Number of elements kept
+         * @details Each vector is compared with value, and its kept lanes are packed with one
+         * permutation and stored at the output position. A store never reaches past the
+         * vector just loaded, so the compaction is safe in place. Until the first match
+         * nothing moves, so nothing is stored either.
+         */
+        template<typename T>
+        __attribute__((target("avx2,popcnt"))) inline size_t compress_not_equal_avx2(T* data, size_t n, T value){
+            static constexpr compress_table table{};
+            size_t kept = 0, i = 0;
+            if constexpr (sizeof(T) == 4){
+                __m256i pattern;
+                if constexpr (std::is_floating_point<T>::value) pattern = _mm256_castps_si256(_mm256_set1_ps(value));
+                else pattern = _mm256_set1_epi32(static_cast<int>(value));
+                for(; i + 8 <= n; i += 8){
+                    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+                    __m256 equal;
+                    if constexpr (std::is_floating_point<T>::value) equal = _mm256_cmp_ps(_mm256_castsi256_ps(x), _mm256_castsi256_ps(pattern), _CMP_EQ_OQ);
+                    else equal = _mm256_castsi256_ps(_mm256_cmpeq_epi32(x, pattern));
+                    unsigned keep = ~static_cast<unsigned>(_mm256_movemask_ps(equal)) & 0xFFu;
+                    if(keep == 0xFFu && kept == i){ kept += 8; continue; }
+                    __m256i lanes = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(table.lanes_32[keep])));
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(data + kept), _mm256_permutevar8x32_epi32(x, lanes));
+                    kept += static_cast<size_t>(_mm_popcnt_u32(keep));
+                }
+            }
+            else{
+                __m256i pattern;
+                if constexpr (std::is_floating_point<T>::value) pattern = _mm256_castpd_si256(_mm256_set1_pd(value));
+                else pattern = _mm256_set1_epi64x(static_cast<long long>(value));
+                for(; i + 4 <= n; i += 4){
+                    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+                    __m256d equal;
+                    if constexpr (std::is_floating_point<T>::value) equal = _mm256_cmp_pd(_mm256_castsi256_pd(x), _mm256_castsi256_pd(pattern), _CMP_EQ_OQ);
+                    else equal = _mm256_castsi256_pd(_mm256_cmpeq_epi64(x, pattern));
+                    unsigned keep = ~static_cast<unsigned>(_mm256_movemask_pd(equal)) & 0xFu;
+                    if(keep == 0xFu && kept == i){ kept += 4; continue; }
+                    __m256i lanes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(table.lanes_64[keep]));
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(data + kept), _mm256_permutevar8x32_epi32(x, lanes));
+                    kept += static_cast<size_t>(_mm_popcnt_u32(keep));
+                }
+            }
+            for(; i < n; ++i){
+                T x = data[i];
+                data[kept] = x;
+                kept += !(x == value);
+            }
+            return kept;
+        }
+#endif
+
+        /**
+         * @brief Drop every element equal to value, keeping the others in order
+         * @param data Elements, compacted in place
+         * @param n Number of elements
+         * @param value The value to drop
+         * @return Number of elements kept
+         * @details Equality is operator== on T (so 0.0 matches -0.0 and NaN matches nothing) on
+         * every path. 32- and 64-bit arithmetic types use the AVX2 kernel when the CPU
+         * supports it; the scalar path is a branchless compaction.
+         */
+        template<typename T>
+        size_t compress_not_equal(T* data, size_t n, T value){
+#if EX4_X86_SIMD
+            if constexpr (std::is_arithmetic<T>::value && !std::is_same<T, bool>::value && (sizeof(T) == 4 || sizeof(T) == 8)){
+                if(active_simd_level() == SimdLevel::avx2) return compress_not_equal_avx2(data, n, value);
+            }
+#endif
+            size_t kept = static_cast<size_t>(std::find(data, data + n, value) - data);
+            for(size_t i = kept; i < n; ++i){
+                T x = data[i];
+                data[kept] = x;
+                kept += !(x == value);
+            }
+            return kept;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,742 @@
+//idocohen963@gmail.com
+
+/**
+ * @file SortAlgorithms.hpp
+ * @brief Sort kernels used behind the ordered iterators of MyContainer
+ */
+#ifndef SORTALGORITHMS_HPP
+#define SORTALGORITHMS_HPP
+
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <cmath>
+#include <utility>
+#include <atomic>
+#include <thread>
+#include <exception>
+#include <string>
+#include "SimdKernels.hpp"
+
+namespace ex4{
+
+    namespace detail{
+
+        /// Below this many elements radix_sort() falls back to std::sort
+        constexpr size_t radix_sort_threshold = 256;
+
+        /**
+         * @brief Maps arithmetic values to unsigned keys whose unsigned order is the value order
+         * @tparam T The element type
+         * @details The primary template is disabled: only types with a specialization can be radix sorted.
+         */
+        template<typename T, typename Enable = void>
+        struct radix_traits{
+            static constexpr bool enabled = false; ///< Whether T can be radix sorted
+        };
+
+        /**
+         * @brief Radix keys for integral types (except bool)
+         * @details Signed values get their sign bit flipped so negative values sort first.
+         */
+        template<typename T>
+        struct radix_traits<T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value>::type>{
+            static constexpr bool enabled = true;                    ///< Whether T can be radix sorted
+            using key_type = typename std::make_unsigned<T>::type;  ///< Unsigned key type
+
+            /**
+             * @brief Compute the radix key of a value
+             * @param value The value
+             * @return Unsigned key with the same order as value
+             */
+            static key_type key(T value){
+                key_type k = static_cast<key_type>(value);
+                if constexpr (std::is_signed<T>::value) k ^= key_type(key_type(1) << (sizeof(key_type) * 8 - 1));
+                return k;
+            }
+
+            /**
+             * @brief Recover the value of a radix key
+             * @param k A key produced by key()
+             * @return The value whose key is k
+             */
+            static T value(key_type k){
+                if constexpr (std::is_signed<T>::value) k ^= key_type(key_type(1) << (sizeof(key_type) * 8 - 1));
+                return static_cast<T>(k);
+            }
+        };
+
+        /**
+         * @brief Radix keys for IEEE-754 float and double
+         * @details Negative values have all bits flipped and non-negative values get the sign bit set,
+         * which orders negatives before -0.0, -0.0 before +0.0, and positives after.
+         */
+        template<typename T>
+        struct radix_traits<T, typename std::enable_if<std::is_floating_point<T>::value && std::numeric_limits<T>::is_iec559
+                                                       && (sizeof(T) == 4 || sizeof(T) == 8)>::type>{
+            static constexpr bool enabled = true;  ///< Whether T can be radix sorted
+            using key_type = typename std::conditional<sizeof(T) == 4, std::uint32_t, std::uint64_t>::type; ///< Unsigned key type
+
+            /**
+             * @brief Compute the radix key of a value
+             * @param value The value
+             * @return Unsigned key with the same order as value
+             */
+            static key_type key(T value){
+                key_type bits;
+                std::memcpy(&bits, &value, sizeof(bits));
+                const key_type sign = key_type(1) << (sizeof(key_type) * 8 - 1);
+                return (bits & sign) ? key_type(~bits) : key_type(bits | sign);
+            }
+
+            /**
+             * @brief Recover the value of a radix key
+             * @param k A key produced by key()
+             * @return The value whose key is k, bit for bit
+             */
+            static T value(key_type k){
+                const key_type sign = key_type(1) << (sizeof(key_type) * 8 - 1);
+                key_type bits = (k & sign) ? key_type(k ^ sign) : key_type(~k);
+                T result;
+                std::memcpy(&result, &bits, sizeof(result));
+                return result;
+            }
+        };
+
+        /**
+         * @brief LSD radix sort of arithmetic values in ascending order
+         * @tparam T An element type with an enabled radix_traits specialization
+         * @param first Pointer to the first element
+         * @param last Pointer past the last element
+         * @details Sorts one byte per pass, with the histograms of every pass gathered in a
+         * single read of the input. Passes in which all keys share the same byte are skipped.
+         * Runs in O(n * sizeof(T)) with one n-element buffer.
+         */
+        template<typename T>
+        void radix_sort(T* first, T* last){
+            using traits = radix_traits<T>;
+            using key_type = typename traits::key_type;
+            constexpr size_t passes = sizeof(key_type);
+            size_t n = static_cast<size_t>(last - first);
+            if(n < radix_sort_threshold){
+                std::sort(first, last, [](const T& a, const T& b){ return traits::key(a) < traits::key(b); });
+                return;
+            }
+
+            std::vector<size_t> counts(passes * 256, 0);
+            for(T* it = first; it != last; ++it){
+                key_type k = traits::key(*it);
+                for(size_t pass = 0; pass < passes; ++pass){
+                    ++counts[pass * 256 + ((k >> (pass * 8)) & 0xFF)];
+                }
+            }
+
+            std::vector<T> buffer(n);
+            T* src = first;
+            T* dst = buffer.data();
+            for(size_t pass = 0; pass < passes; ++pass){
+                size_t* count = &counts[pass * 256];
+                if(count[(traits::key(*src) >> (pass * 8)) & 0xFF] == n) continue;
+                size_t offset = 0;
+                for(size_t digit = 0; digit < 256; ++digit){
+                    size_t c = count[digit];
+                    count[digit] = offset;
+                    offset += c;
+                }
+                for(T* it = src; it != src + n; ++it){
+                    dst[count[(traits::key(*it) >> (pass * 8)) & 0xFF]++] = *it;
+                }
+                std::swap(src, dst);
+            }
+            if(src != first) std::copy(src, src + n, first);
+        }
+
+        /// Up to this many elements sort_arithmetic() may use network_sort() on AVX2 CPUs
+        constexpr size_t network_sort_limit = 4096;
+
+        /// Below this many elements network_sort() falls back to std::sort
+        constexpr size_t network_sort_threshold = 16;
+
+        /**
+         * @brief Sorting-network sort of arithmetic values in ascending order
+         * @tparam T An element type with an enabled radix_traits specialization
+         * @param first Pointer to the first element
+         * @param last Pointer past the last element
+         * @details Values are mapped to their radix keys, padded with the largest key to a whole
+         * number of network blocks, sorted into short runs by a SIMD sorting network (AVX2 or
+         * SSE4.1 when the CPU has it, scalar otherwise) and merged bottom-up. The keys are a total
+         * order, so every path writes back the same bits.
+         */
+        template<typename T>
+        void network_sort(T* first, T* last){
+            using traits = radix_traits<T>;
+            using key_type = typename traits::key_type;
+            size_t n = static_cast<size_t>(last - first);
+            if(n < network_sort_threshold){
+                std::sort(first, last, [](const T& a, const T& b){ return traits::key(a) < traits::key(b); });
+                return;
+            }
+
+            size_t padded = (n + network_block - 1) / network_block * network_block;
+            std::vector<key_type> keys(padded, std::numeric_limits<key_type>::max());
+            for(size_t i = 0; i < n; ++i) keys[i] = traits::key(first[i]);
+            network_sort_keys(keys.data(), padded);
+            for(size_t i = 0; i < n; ++i) first[i] = traits::value(keys[i]);
+        }
+
+        /**
+         * @brief Selects the byte-string sort for a string type
+         * @details Enabled for std::basic_string<char> with the standard traits, whose operator<
+         * compares bytes as unsigned char, the same order as big-endian prefixes.
+         */
+        template<typename T>
+        struct is_byte_string : std::false_type {};
+
+        template<typename Alloc>
+        struct is_byte_string<std::basic_string<char, std::char_traits<char>, Alloc>> : std::true_type {};
+
+        /**
+         * @brief Entry of string_sort(): the cached prefix of a string and its index
+         */
+        struct string_slot{
+            std::uint64_t prefix; ///< Eight bytes of the string from the current depth, big-endian and zero-padded
+            size_t index;         ///< Index of the string
+        };
+
+        /**
+         * @brief Read eight bytes of a string as a big-endian integer
+         * @param str The string
+         * @param depth Offset of the first byte
+         * @return The bytes at [depth, depth + 8), zero-padded past the end of the string
+         */
+        template<typename String>
+        std::uint64_t string_prefix(const String& str, size_t depth){
+            size_t available = depth < str.size() ? std::min<size_t>(8, str.size() - depth) : 0;
+            unsigned char bytes[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+            if(available != 0) std::memcpy(bytes, str.data() + depth, available);
+            std::uint64_t prefix = 0;
+            for(unsigned char byte : bytes) prefix = (prefix << 8) | byte;
+            return prefix;
+        }
+
+        /**
+         * @brief Sort string slots that share their first depth bytes
+         * @param first First slot, with prefixes loaded at depth
+         * @param last Past the last slot
+         * @param strings The strings the slots refer to
+         * @param depth Number of leading bytes already known to be equal
+         * @details Slots are sorted by their cached prefix, so most comparisons are integer
+         * comparisons that never touch the string storage; a block that shares the whole
+         * prefix skips the sort. Each run of equal prefixes is then
+         * resolved: strings that end inside the prefix go first, shortest first (a shorter
+         * string is a proper prefix of the longer ones), and the rest are sorted on their
+         * next eight bytes. The descent goes one level per eight shared bytes, so the runs
+         * left to sort are kept on an explicit stack rather than recursed into: strings that
+         * share a prefix of megabytes must not overflow the call stack.
+         */
+        template<typename String>
+        void string_sort_slots(string_slot* first, string_slot* last, const String* strings, size_t depth){
+            struct pending_block{
+                string_slot* first;
+                string_slot* last;
+                size_t depth;
+            };
+            std::vector<pending_block> pending{{first, last, depth}};
+            while(!pending.empty()){
+                pending_block block = pending.back();
+                pending.pop_back();
+                string_slot* begin = block.first;
+                auto differs = [begin](const string_slot& slot){ return slot.prefix != begin->prefix; };
+                if(std::any_of(block.first + 1, block.last, differs)){
+                    std::sort(block.first, block.last, [](const string_slot& a, const string_slot& b){ return a.prefix < b.prefix; });
+                }
+                for(string_slot* run = block.first; run != block.last;){
+                    string_slot* run_end = run + 1;
+                    while(run_end != block.last && run_end->prefix == run->prefix) ++run_end;
+                    if(run_end - run > 1){
+                        string_slot* unfinished = std::partition(run, run_end, [&](const string_slot& slot){
+                            return strings[slot.index].size() <= block.depth + 8;
+                        });
+                        std::sort(run, unfinished, [&](const string_slot& a, const string_slot& b){
+                            return strings[a.index].size() < strings[b.index].size();
+                        });
+                        if(run_end - unfinished > 1){
+                            for(string_slot* slot = unfinished; slot != run_end; ++slot){
+                                slot->prefix = string_prefix(strings[slot->index], block.depth + 8);
+                            }
+                            pending.push_back({unfinished, run_end, block.depth + 8});
+                        }
+                    }
+                    run = run_end;
+                }
+            }
+        }
+
+        /**
+         * @brief Sort indices of byte strings by the strings they refer to
+         * @param first Pointer to the first index
+         * @param last Pointer past the last index
+         * @param strings The strings, indexed by the values in [first, last)
+         * @details An MSD sort on cached 8-byte prefixes: shared prefixes are read once per
+         * eight bytes instead of once per comparison, which matters for long keys that share
+         * long prefixes, such as URLs.
+         */
+        template<typename String>
+        void string_sort(size_t* first, size_t* last, const String* strings){
+            size_t n = static_cast<size_t>(last - first);
+            if(n < 2) return;
+            std::vector<string_slot> slots(n);
+            for(size_t i = 0; i < n; ++i) slots[i] = {string_prefix(strings[first[i]], 0), first[i]};
+            string_sort_slots(slots.data(), slots.data() + n, strings, 0);
+            for(size_t i = 0; i < n; ++i) first[i] = slots[i].index;
+        }
+
+        /// natural_merge_sort() extends shorter runs to this length with insertion sort
+        constexpr size_t natural_min_run = 32;
+
+        /// adaptive_sort() uses natural_merge_sort() when at most one adjacent pair in this many is a descent
+        constexpr size_t natural_merge_divisor = 3;
+
+        /**
+         * @brief Count adjacent pairs that are out of order
+         * @param first Pointer to the first element
+         * @param last Pointer past the last element
+         * @param less Strict weak ordering
+         * @return Number of positions i with less(first[i], first[i - 1])
+         */
+        template<typename T, typename Less>
+        size_t count_descents(const T* first, const T* last, const Less& less){
+            size_t descents = 0;
+            for(const T* it = first; it != last && it + 1 != last; ++it) descents += less(it[1], it[0]);
+            return descents;
+        }
+
+        /**
+         * @brief Stably merge two adjacent sorted runs in place, using a buffer for the overlap
+         * @param first Start of the first run
+         * @param middle End of the first run and start of the second
+         * @param last End of the second run
+         * @param less Strict weak ordering
+         * @param buffer Scratch storage, reused across calls
+         * @details Elements of the first run that are not greater than the second run's first
+         * element, and elements of the second run that are not less than the first run's
+         * last element, are already in place and are skipped by binary search. Nearly sorted
+         * runs overlap only a little, so such merges cost far less than their length.
+         */
+        template<typename T, typename Less>
+        void merge_adjacent_runs(T* first, T* middle, T* last, const Less& less, std::vector<T>& buffer){
+            if(first == middle || middle == last || !less(*middle, *(middle - 1))) return;
+            first = std::upper_bound(first, middle, *middle, less);
+            last = std::lower_bound(middle, last, *(middle - 1), less);
+            buffer.assign(first, middle);
+            std::merge(buffer.begin(), buffer.end(), middle, last, first, less);
+        }
+
+        /**
+         * @brief Adaptive, stable natural merge sort in the style of TimSort
+         * @param first Pointer to the first element
+         * @param last Pointer past the last element
+         * @param less Strict weak ordering
+         * @details Splits the range into its existing runs; strictly descending runs are
+         * reversed in place and runs shorter than natural_min_run are extended with binary
+         * insertion sort. Runs are then merged pairwise, bottom-up, with merge_adjacent_runs().
+         * Sorted input costs n - 1 comparisons, and input made of a few runs, or with small
+         * local disorder such as jittered timestamps, sorts in close to linear time.
+         */
+        template<typename T, typename Less>
+        void natural_merge_sort(T* first, T* last, const Less& less){
+            size_t n = static_cast<size_t>(last - first);
+            if(n < 2) return;
+            std::vector<size_t> bounds(1, 0);
+            for(size_t start = 0; start < n;){
+                size_t end = start + 1;
+                if(end < n && less(first[end], first[end - 1])){
+                    while(end < n && less(first[end], first[end - 1])) ++end;
+                    std::reverse(first + start, first + end);
+                }
+                else{
+                    while(end < n && !less(first[end], first[end - 1])) ++end;
+                }
+                size_t extended = std::min(n, std::max(end, start + natural_min_run));
+                for(; end < extended; ++end){
+                    T* position = std::upper_bound(first + start, first + end, first[end], less);
+                    std::rotate(position, first + end, first + end + 1);
+                }
+                bounds.push_back(end);
+                start = end;
+            }
+
+            std::vector<T> buffer;
+            while(bounds.size() > 2){
+                std::vector<size_t> next_bounds(1, 0);
+                for(size_t r = 0; r + 1 < bounds.size(); r += 2){
+                    if(r + 2 < bounds.size()){
+                        merge_adjacent_runs(first + bounds[r], first + bounds[r + 1], first + bounds[r + 2], less, buffer);
+                        next_bounds.push_back(bounds[r + 2]);
+                    }
+                    else{
+                        next_bounds.push_back(bounds[r + 1]);
+                    }
+                }
+                bounds.swap(next_bounds);
+            }
+        }
+
+        /**
+         * @brief Sort a range, taking advantage of existing order
+         * @param first Pointer to the first element
+         * @param last Pointer past the last element
+         * @param less Strict weak ordering
+         * @param sort_range Callable sort_range(first, last) used for input without useful order
+         * @details Counts the descents first: sorted input returns at once, nearly sorted input
+         * goes to natural_merge_sort(), and everything else to sort_range.
+         */
+        template<typename T, typename Less, typename SortRange>
+        void adaptive_sort(T* first, T* last, const Less& less, const SortRange& sort_range){
+            size_t descents = count_descents(first, last, less);
+            if(descents == 0) return;
+            if(descents <= static_cast<size_t>(last - first) / natural_merge_divisor) natural_merge_sort(first, last, less);
+            else sort_range(first, last);
+        }
+
+        /// Below this many elements sort_arithmetic() uses insertion sort
+        constexpr size_t insertion_sort_threshold = 16;
+
+        /// Counting sort is used when the value range is at most this many times max(n, 256)
+        constexpr size_t counting_sort_range_factor = 4;
+
+        /// dictionary_sort() gives up past this many distinct values
+        constexpr size_t dictionary_sort_max_distinct = 64;
+
+        /// Number of HyperLogLog registers kept by value_stats
+        constexpr size_t distinct_registers = 64;
+
+        /**
+         * @brief Scramble the bits of a 64-bit value (the splitmix64 finalizer)
+         * @param x The value
+         * @return A well-mixed hash of x
+         */
+        inline std::uint64_t mix_bits(std::uint64_t x){
+            x ^= x >> 30;
+            x *= 0xbf58476d1ce4e5b9ULL;
+            x ^= x >> 27;
+            x *= 0x94d049bb133111ebULL;
+            return x ^ (x >> 31);
+        }
+
+        /**
+         * @brief Running statistics of arithmetic values, updated in O(1) per value
+         * @tparam T An element type with an enabled radix_traits specialization
+         * @details Tracks the minimum and maximum (in radix key order, so -0.0 < +0.0) and a
+         * HyperLogLog estimate of the number of distinct values in 64 bytes of registers.
+         */
+        template<typename T>
+        struct value_stats{
+            using traits = radix_traits<T>;
+
+            size_t count = 0;                                  ///< Number of values seen
+            T min = T();                                       ///< Smallest value seen (valid if count > 0)
+            T max = T();                                       ///< Largest value seen (valid if count > 0)
+            unsigned char registers[distinct_registers] = {};  ///< HyperLogLog registers
+
+            /**
+             * @brief Account for one more value
+             * @param value The value
+             */
+            void add(T value){
+                auto key = traits::key(value);
+                if(count == 0 || key < traits::key(min)) min = value;
+                if(count == 0 || key > traits::key(max)) max = value;
+                ++count;
+                std::uint64_t hash = mix_bits(static_cast<std::uint64_t>(key));
+                size_t slot = static_cast<size_t>(hash >> 58);
+                std::uint64_t rest = hash << 6;
+                unsigned char rank = 1;
+                while(rank < 59 && !(rest & (std::uint64_t(1) << 63))){
+                    rest <<= 1;
+                    ++rank;
+                }
+                if(rank > registers[slot]) registers[slot] = rank;
+            }
+
+            /**
+             * @brief Forget every value seen
+             */
+            void clear(){ *this = value_stats(); }
+
+            /**
+             * @brief Estimate how many distinct values were seen
+             * @return The HyperLogLog estimate (about 13% standard error), at most count
+             */
+            size_t distinct_estimate() const{
+                double sum = 0;
+                size_t zeros = 0;
+                for(unsigned char reg : registers){
+                    sum += 1.0 / static_cast<double>(std::uint64_t(1) << reg);
+                    zeros += reg == 0;
+                }
+                const double m = static_cast<double>(distinct_registers);
+                double estimate = 0.709 * m * m / sum;
+                if(estimate <= 2.5 * m && zeros != 0) estimate = m * std::log(m / static_cast<double>(zeros));
+                return std::min(count, static_cast<size_t>(estimate + 0.5));
+            }
+        };
+
+        /**
+         * @brief Strategies sort_arithmetic() chooses from
+         */
+        enum class SortStrategy{
+            none,          ///< Already sorted
+            insertion,     ///< Insertion sort, for tiny ranges
+            natural_merge, ///< natural_merge_sort(), for nearly sorted ranges
+            counting,      ///< counting_sort(), for integers in a narrow range
+            dictionary,    ///< dictionary_sort(), for heavily duplicated values
+            network,       ///< network_sort(), for small ranges on AVX2 CPUs
+            radix          ///< radix_sort(), for everything else
+        };
+
+        /**
+         * @brief Pick the sort strategy for a range of arithmetic values
+         * @param n Number of values in the range
+         * @param descents Number of adjacent pairs of the range that are out of order
+         * @param stats Statistics of a superset of the range's values
+         * @return The strategy expected to be fastest
+         */
+        template<typename T>
+        SortStrategy choose_sort_strategy(size_t n, size_t descents, const value_stats<T>& stats){
+            using traits = radix_traits<T>;
+            if(descents == 0) return SortStrategy::none;
+            if(n < insertion_sort_threshold) return SortStrategy::insertion;
+            if(descents <= n / natural_merge_divisor) return SortStrategy::natural_merge;
+            if constexpr (std::is_integral<T>::value){
+                std::uint64_t range = static_cast<std::uint64_t>(traits::key(stats.max) - traits::key(stats.min));
+                if(range < counting_sort_range_factor * std::max<size_t>(n, 256)) return SortStrategy::counting;
+            }
+            if(n >= 1024 && stats.distinct_estimate() <= dictionary_sort_max_distinct / 2) return SortStrategy::dictionary;
+            using key_type = typename traits::key_type;
+            if((sizeof(key_type) == 4 || sizeof(key_type) == 8) && n <= network_sort_limit
+               && active_simd_level() == SimdLevel::avx2) return SortStrategy::network;
+            return SortStrategy::radix;
+        }
+
+        /**
+         * @brief Counting sort of integers
+         * @param first Pointer to the first element
+         * @param last Pointer past the last element
+         * @param min A value not greater than any element
+         * @param max A value not less than any element
+         * @details O(n + max - min) time with one counter per value of the range.
+         */
+        template<typename T>
+        void counting_sort(T* first, T* last, T min, T max){
+            using traits = radix_traits<T>;
+            using key_type = typename traits::key_type;
+            key_type base = traits::key(min);
+            std::vector<size_t> counts(static_cast<size_t>(traits::key(max) - base) + 1, 0);
+            for(T* it = first; it != last; ++it) ++counts[static_cast<size_t>(traits::key(*it) - base)];
+            T* out = first;
+            for(size_t offset = 0; offset < counts.size(); ++offset){
+                out = std::fill_n(out, counts[offset], traits::value(static_cast<key_type>(base + offset)));
+            }
+        }
+
+        /**
+         * @brief Sort values drawn from a handful of distinct values
+         * @param first Pointer to the first element
+         * @param last Pointer past the last element
+         * @return False, leaving the range untouched, if it holds more than dictionary_sort_max_distinct distinct values
+         * @details Counts every distinct value in a small open-addressing table, sorts the
+         * distinct values and writes each one out as many times as it was seen: one hash
+         * probe per element, however wide the value range is.
+         */
+        template<typename T>
+        bool dictionary_sort(T* first, T* last){
+            using traits = radix_traits<T>;
+            using key_type = typename traits::key_type;
+            constexpr size_t table_size = dictionary_sort_max_distinct * 2;
+            key_type keys[table_size];
+            size_t counts[table_size] = {};
+            size_t distinct = 0;
+            for(T* it = first; it != last; ++it){
+                key_type key = traits::key(*it);
+                size_t slot = static_cast<size_t>(mix_bits(static_cast<std::uint64_t>(key))) & (table_size - 1);
+                while(counts[slot] != 0 && keys[slot] != key) slot = (slot + 1) & (table_size - 1);
+                if(counts[slot] == 0){
+                    if(++distinct > dictionary_sort_max_distinct) return false;
+                    keys[slot] = key;
+                }
+                ++counts[slot];
+            }
+            std::vector<std::pair<key_type, size_t>> entries;
+            entries.reserve(distinct);
+            for(size_t slot = 0; slot < table_size; ++slot){
+                if(counts[slot] != 0) entries.push_back({keys[slot], counts[slot]});
+            }
+            std::sort(entries.begin(), entries.end());
+            T* out = first;
+            for(const auto& entry : entries) out = std::fill_n(out, entry.second, traits::value(entry.first));
+            return true;
+        }
+
+        /**
+         * @brief Sort arithmetic values with the strategy their statistics call for
+         * @param first Pointer to the first element
+         * @param last Pointer past the last element
+         * @param stats Statistics of a superset of the range's values
+         * @details Values are ordered by radix key (see radix_traits), so every strategy
+         * produces the same bits.
+         */
+        template<typename T>
+        void sort_arithmetic(T* first, T* last, const value_stats<T>& stats){
+            using traits = radix_traits<T>;
+            auto less = [](const T& a, const T& b){ return traits::key(a) < traits::key(b); };
+            switch(choose_sort_strategy(static_cast<size_t>(last - first), count_descents(first, last, less), stats)){
+                case SortStrategy::none:
+                    return;
+                case SortStrategy::insertion:
+                    for(T* it = first; it != last; ++it) std::rotate(std::upper_bound(first, it, *it, less), it, it + 1);
+                    return;
+                case SortStrategy::natural_merge:
+                    natural_merge_sort(first, last, less);
+                    return;
+                case SortStrategy::counting:
+                    if constexpr (std::is_integral<T>::value) counting_sort(first, last, stats.min, stats.max);
+                    return;
+                case SortStrategy::dictionary:
+                    if(!dictionary_sort(first, last)) radix_sort(first, last);
+                    return;
+                case SortStrategy::network:
+                    network_sort(first, last);
+                    return;
+                case SortStrategy::radix:
+                    radix_sort(first, last);
+                    return;
+            }
+        }
+
+        /// parallel_merge_sort() gives every worker at least this many elements
+        constexpr size_t parallel_sort_min_chunk = size_t(1) << 16;
+
+        /**
+         * @brief Run count tasks on separate threads and wait for all of them
+         * @param count Number of tasks
+         * @param task Callable invoked as task(i) for every i in [0, count)
+         * @details Task 0 runs on the calling thread. If a thread cannot be started, the
+         * calling thread also runs the tasks left without one. The first exception thrown by a
+         * task is rethrown here once every thread has joined.
+         */
+        template<typename Task>
+        void run_parallel(size_t count, const Task& task){
+            std::vector<std::exception_ptr> errors(count);
+            std::vector<std::thread> workers;
+            workers.reserve(count);
+            auto guarded = [&](size_t i){
+                try{ task(i); }
+                catch(...){ errors[i] = std::current_exception(); }
+            };
+            size_t started = 1;
+            for(; started < count; ++started){
+                try{ workers.emplace_back(guarded, started); }
+                catch(...){ break; }    // No thread available: the running workers must still be joined
+            }
+            guarded(0);
+            for(size_t i = started; i < count; ++i) guarded(i);
+            for(std::thread& worker : workers) worker.join();
+            for(std::exception_ptr& error : errors){
+                if(error) std::rethrow_exception(error);
+            }
+        }
+
+        /**
+         * @brief Find where the first diagonal elements of a stable merge split between two runs
+         * @param a First sorted run
+         * @param na Length of a
+         * @param b Second sorted run
+         * @param nb Length of b
+         * @param diagonal Number of merged elements
+         * @param less Strict weak ordering
+         * @return How many of the first diagonal merged elements come from a (ties favor a)
+         */
+        template<typename RandomIt, typename Less>
+        size_t merge_path_split(RandomIt a, size_t na, RandomIt b, size_t nb, size_t diagonal, const Less& less){
+            size_t low = diagonal > nb ? diagonal - nb : 0;
+            size_t high = std::min(diagonal, na);
+            while(low < high){
+                size_t mid = low + (high - low) / 2;
+                if(less(b[diagonal - mid - 1], a[mid])) high = mid;
+                else low = mid + 1;
+            }
+            return low;
+        }
+
+        /**
+         * @brief Sort a range on several threads with a parallel merge sort
+         * @param first Pointer to the first element
+         * @param last Pointer past the last element
+         * @param less Strict weak ordering used for merging
+         * @param threads Maximum number of threads to use
+         * @param sort_chunk Callable sort_chunk(first, last) that sorts a sub-range consistently with less
+         * @details The range is cut into one chunk per thread and the chunks are sorted
+         * concurrently. Sorted runs are then merged pairwise, and every merge is itself split
+         * into independent pieces along its merge path so that all threads stay busy until
+         * the last round. Falls back to a single sort_chunk() call when the range is too
+         * small to give every thread parallel_sort_min_chunk elements.
+         */
+        template<typename T, typename Less, typename SortChunk>
+        void parallel_merge_sort(T* first, T* last, const Less& less, size_t threads, const SortChunk& sort_chunk){
+            size_t n = static_cast<size_t>(last - first);
+            threads = std::min(threads, n / parallel_sort_min_chunk);
+            if(threads < 2){
+                sort_chunk(first, last);
+                return;
+            }
+
+            std::vector<size_t> bounds(threads + 1);
+            for(size_t i = 0; i <= threads; ++i) bounds[i] = n * i / threads;
+            run_parallel(threads, [&](size_t i){ sort_chunk(first + bounds[i], first + bounds[i + 1]); });
+
+            struct MergePiece{ size_t a, a_end, b, b_end, out; };
+            std::vector<T> buffer(first, last);
+            T* src = first;
+            T* dst = buffer.data();
+            while(bounds.size() > 2){
+                size_t runs = bounds.size() - 1;
+                size_t pairs = runs / 2;
+                size_t pieces_per_pair = std::max<size_t>(1, threads / pairs);
+                std::vector<MergePiece> pieces;
+                std::vector<size_t> next_bounds(1, 0);
+                for(size_t r = 0; r + 1 < runs; r += 2){
+                    size_t a = bounds[r], b = bounds[r + 1], end = bounds[r + 2];
+                    size_t total = end - a;
+                    size_t prev_diagonal = 0, prev_split = 0;
+                    for(size_t p = 1; p <= pieces_per_pair; ++p){
+                        size_t diagonal = total * p / pieces_per_pair;
+                        size_t split = merge_path_split(src + a, b - a, src + b, end - b, diagonal, less);
+                        pieces.push_back({a + prev_split, a + split, b + (prev_diagonal - prev_split),
+                                          b + (diagonal - split), a + prev_diagonal});
+                        prev_diagonal = diagonal;
+                        prev_split = split;
+                    }
+                    next_bounds.push_back(end);
+                }
+                if(runs % 2 == 1){
+                    pieces.push_back({bounds[runs - 1], bounds[runs], bounds[runs], bounds[runs], bounds[runs - 1]});
+                    next_bounds.push_back(bounds[runs]);
+                }
+                run_parallel(pieces.size(), [&](size_t i){
+                    const MergePiece& piece = pieces[i];
+                    std::merge(src + piece.a, src + piece.a_end, src + piece.b, src + piece.b_end, dst + piece.out, less);
+                });
+                bounds.swap(next_bounds);
+                std::swap(src, dst);
+            }
+            if(src != first) std::copy(src, src + n, first);
+        }
+    }
+}
+
+#endif
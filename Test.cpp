@@ -2,9 +2,22 @@
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include "doctest.h"
 #include "MyContainer.hpp"
+#include "CountedContainer.hpp"
 #include <string>
 #include <sstream>
 #include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <iterator>
+#include <type_traits>
+#include <thread>
+#if __cplusplus >= 202002L
+#include <ranges>
+#include <span>
+#endif
 
 using namespace ex4;
 
@@ -129,6 +142,196 @@ TEST_SUITE("Core Functionality & Constructors") {
         ss << container;
         CHECK(ss.str() == "[42]");
     }
+    
+    // Checks that moving a container hands over its storage instead of copying it.
+    TEST_CASE("Move constructor and assignment") {
+        static_assert(std::is_nothrow_move_constructible<MyContainer<std::string>>::value);
+        static_assert(std::is_nothrow_move_assignable<MyContainer<std::string>>::value);
+        
+        MyContainer<std::string> source;
+        source.set_hash_index(true);
+        for (const char* word : {"pear", "fig", "apple"}) source.add(word);
+        CHECK(*source.begin_ascending_order() == "apple");
+        const std::string* storage = &*source.begin_order();
+        
+        MyContainer<std::string> moved(std::move(source));
+        CHECK(&*moved.begin_order() == storage);
+        CHECK(moved.size() == 3);
+        CHECK(moved.contains("fig"));
+        CHECK(*moved.begin_descending_order() == "pear");
+        CHECK(source.size() == 0);
+        CHECK_FALSE(source.contains("fig"));
+        CHECK(source.begin_ascending_order() == source.end_ascending_order());
+        source.add("kiwi");
+        CHECK(*source.begin_ascending_order() == "kiwi");
+        
+        MyContainer<std::string> target;
+        target.add("old");
+        target = std::move(moved);
+        CHECK(&*target.begin_order() == storage);
+        CHECK(target.size() == 3);
+        CHECK(*target.begin_ascending_order() == "apple");
+        CHECK(moved.size() == 0);
+    }
+    
+    // Checks that add() moves rvalues and emplace() constructs in place.
+    TEST_CASE("Rvalue add and emplace") {
+        MyContainer<std::string> container;
+        std::string word(100, 'x');
+        const char* buffer = word.data();
+        container.add(std::move(word));
+        CHECK(container.begin_order()->data() == buffer);
+        
+        const std::string& emplaced = container.emplace(3, 'a');
+        CHECK(emplaced == "aaa");
+        CHECK(container.size() == 2);
+        CHECK(*container.begin_ascending_order() == "aaa");
+        
+        MyContainer<int> numbers;
+        numbers.emplace(5);
+        numbers.add(3);
+        CHECK(*numbers.begin_ascending_order() == 3);
+        CHECK_FALSE(numbers.is_sorted());
+    }
+    
+    // Checks a move-only element type ordered through a projection.
+    TEST_CASE("Move-only elements") {
+        auto pointee = [](const std::unique_ptr<int>& p) { return *p; };
+        MyContainer<std::unique_ptr<int>, std::less<>, decltype(pointee)> container(std::less<>{}, pointee);
+        container.add(std::make_unique<int>(5));
+        container.emplace(new int(1));
+        container.add(std::make_unique<int>(3));
+        
+        std::vector<int> ascending;
+        for (const auto& p : container.ascending()) ascending.push_back(*p);
+        CHECK(ascending == std::vector<int>{1, 3, 5});
+        CHECK(**container.begin_descending_order() == 5);
+        
+        CHECK(container.remove_if([](const std::unique_ptr<int>& p) { return *p == 3; }) == 1);
+        auto moved = std::move(container);
+        CHECK(moved.size() == 2);
+        CHECK(**moved.begin_ascending_order() == 1);
+        CHECK(**moved.begin_order() == 5);
+    }
+    
+    // Checks the list and iterator-range constructors.
+    TEST_CASE("Bulk constructors") {
+        MyContainer<int> listed{7, 15, 6, 1, 2};
+        std::stringstream ss;
+        ss << listed;
+        CHECK(ss.str() == "[7, 15, 6, 1, 2]");
+        CHECK(*listed.begin_ascending_order() == 1);
+        CHECK_FALSE(listed.is_sorted());
+        
+        std::vector<double> values{1.5, 2.5, 4.0};
+        MyContainer<double> ranged(values.begin(), values.end());
+        CHECK(ranged.size() == 3);
+        CHECK(ranged.is_sorted());
+        
+        std::istringstream input("9 8 7");
+        MyContainer<int> streamed{std::istream_iterator<int>(input), std::istream_iterator<int>()};
+        CHECK(streamed.size() == 3);
+        CHECK(*streamed.begin_ascending_order() == 7);
+        
+        MyContainer<int, std::greater<>> descending({3, 9, 4}, std::greater<>{});
+        CHECK(*descending.begin_ascending_order() == 9);
+    }
+    
+    // Checks that add_range() matches one add() per element, moves from rvalue ranges and feeds every index.
+    TEST_CASE("Bulk add") {
+        std::vector<int> values;
+        for (int i = 0; i < 5000; ++i) values.push_back(i * 7919 % 1000);
+        MyContainer<int> bulk;
+        MyContainer<int> single;
+        bulk.set_hash_index(true);
+        bulk.add(-1);
+        single.add(-1);
+        bulk.add_range(values);
+        for (int value : values) single.add(value);
+        bulk.add_range({4, 2});
+        single.add(4);
+        single.add(2);
+        
+        CHECK(bulk.size() == single.size());
+        CHECK(bulk.contains(999));
+        CHECK(bulk.try_remove(999) == 5);
+        CHECK(single.try_remove(999) == 5);
+        std::vector<int> bulk_ascending(bulk.ascending().begin(), bulk.ascending().end());
+        std::vector<int> single_ascending(single.ascending().begin(), single.ascending().end());
+        CHECK(bulk_ascending == single_ascending);
+        
+        MyContainer<int> sorted;
+        sorted.add_range(std::vector<int>{1, 2, 3});
+        sorted.add_range(std::vector<int>{3, 5});
+        CHECK(sorted.is_sorted());
+        sorted.add_range(std::vector<int>{4});
+        CHECK_FALSE(sorted.is_sorted());
+        
+        std::vector<std::string> words{std::string(50, 'b'), std::string(50, 'a')};
+        const char* buffer = words[1].data();
+        MyContainer<std::string> strings;
+        strings.add_range(std::move(words));
+        CHECK(strings.begin_ascending_order()->data() == buffer);
+    }
+    
+    // Checks that add_range() leaves the container unchanged when reading an input range fails midway.
+    TEST_CASE("Bulk add from a failing input range") {
+        MyContainer<int, std::less<>, std::negate<>> keyed(std::less<>{}, std::negate<>{});
+        keyed.add(5);
+        keyed.add(7);
+        std::istringstream input("3 1 x 2");
+        input.exceptions(std::ios::failbit);
+        CHECK_THROWS_AS(keyed.add_range(std::istream_iterator<int>(input), std::istream_iterator<int>()), std::ios::failure);
+        CHECK(keyed.size() == 2);
+        
+        keyed.add(6);
+        std::vector<int> order(keyed.ascending().begin(), keyed.ascending().end());
+        CHECK(order == std::vector<int>{7, 6, 5});
+        std::ostringstream text;
+        text << keyed;
+        CHECK(text.str() == "[5, 7, 6]");
+    }
+    
+    // Checks that a container can append its own orders, which add_range() reads while it grows.
+    TEST_CASE("Bulk add from the container itself") {
+        MyContainer<std::string> words{"b", "a"};
+        words.add_range(words.in_order());
+        std::ostringstream text;
+        text << words;
+        CHECK(text.str() == "[b, a, b, a]");
+        words.add_range(words.ascending());
+        std::vector<std::string> order(words.in_order().begin(), words.in_order().end());
+        CHECK(order == std::vector<std::string>{"b", "a", "b", "a", "a", "a", "b", "b"});
+        
+        MyContainer<int> numbers;
+        numbers.set_compaction_threshold(1.0);
+        for (int i = 0; i < 1000; ++i) numbers.add(i * 7919 % 1000);
+        numbers.remove(5);
+        numbers.add_range(numbers.ascending());
+        numbers.add_range(numbers.in_order());
+        CHECK(numbers.size() == 3996);
+        std::vector<int> all(numbers.in_order().begin(), numbers.in_order().end());
+        CHECK(all[999] == 0);
+        CHECK(all[1004] == 6);
+        CHECK(all[1997] == 999);
+        CHECK(std::equal(all.begin(), all.begin() + 1998, all.begin() + 1998));
+    }
+    
+#if __cplusplus >= 202002L
+    // Checks that add_range() copies from rvalue views and spans instead of moving out of the elements they borrow.
+    TEST_CASE("Bulk add from borrowed ranges") {
+        std::vector<std::string> words{std::string(40, 'c'), std::string(40, 'a'), std::string(40, 'b')};
+        const std::vector<std::string> original = words;
+        MyContainer<std::string> strings;
+        strings.add_range(std::views::all(words));
+        strings.add_range(std::span<std::string>(words));
+        strings.add_range(words | std::views::take(2));
+        CHECK(words == original);
+        CHECK(strings.size() == 8);
+        CHECK(*strings.begin_ascending_order() == original[1]);
+        CHECK(strings.begin_ascending_order()[7] == original[0]);
+    }
+#endif
 }
 
 TEST_SUITE("Iterator Functionality") {
@@ -240,6 +443,92 @@ TEST_SUITE("Iterator Functionality") {
         CHECK(result == expected);
     }
 
+    // Checks that ascending and descending scans read the same cached sorted snapshot.
+    TEST_CASE("Ordered iterators share a cached sorted snapshot") {
+        MyContainer<int> container;
+        container.add(8);
+        container.add(2);
+        container.add(5);
+        
+        const int* first_scan = &*container.begin_ascending_order();
+        const int* second_scan = &*container.begin_ascending_order();
+        CHECK(first_scan == second_scan);
+        
+        auto desc_it = container.begin_descending_order();
+        ++desc_it;
+        ++desc_it;
+        CHECK(*desc_it == 2);
+        CHECK(&*desc_it == first_scan);
+    }
+    
+    // Checks that the sorted snapshot is rebuilt after the container changes.
+    TEST_CASE("Sorted snapshot follows add and remove") {
+        MyContainer<int> container;
+        container.add(4);
+        container.add(9);
+        CHECK(*container.begin_ascending_order() == 4);
+        
+        container.add(1);
+        CHECK(*container.begin_ascending_order() == 1);
+        CHECK(*container.begin_descending_order() == 9);
+        
+        container.remove(9);
+        std::vector<int> result;
+        for (auto it = container.begin_descending_order(); it != container.end_descending_order(); ++it) {
+            result.push_back(*it);
+        }
+        CHECK(result == std::vector<int>{4, 1});
+    }
+
+    // Checks that elements appended between ordered scans are merged into the snapshot correctly.
+    TEST_CASE("Sorted snapshot merges appended batches") {
+        MyContainer<int> container;
+        std::vector<int> reference;
+        int batches[][3] = {{40, 10, 30}, {5, 50, 20}, {25, 1, 60}, {30, 30, -7}};
+        
+        for (auto& batch : batches) {
+            for (int value : batch) {
+                container.add(value);
+                reference.push_back(value);
+            }
+            std::sort(reference.begin(), reference.end());
+            
+            std::vector<int> result;
+            for (auto it = container.begin_ascending_order(); it != container.end_ascending_order(); ++it) {
+                result.push_back(*it);
+            }
+            CHECK(result == reference);
+        }
+    }
+
+    // Checks that removals keep the sorted snapshot consistent with the elements.
+    TEST_CASE("Sorted snapshot maintained across remove") {
+        MyContainer<int> container;
+        for (int value : {6, 3, 9, 3, 1, 7}) {
+            container.add(value);
+        }
+        container.begin_ascending_order();
+        container.add(3);
+        container.add(4);
+        
+        container.remove(3);
+        container.remove(9);
+        
+        std::vector<int> result;
+        for (auto it = container.begin_ascending_order(); it != container.end_ascending_order(); ++it) {
+            result.push_back(*it);
+        }
+        CHECK(result == std::vector<int>{1, 4, 6, 7});
+        
+        std::stringstream ss;
+        ss << container;
+        CHECK(ss.str() == "[6, 1, 7, 4]");
+        
+        CHECK_THROWS_AS(container.remove(3), std::runtime_error);
+        container.add(0);
+        CHECK(*container.begin_ascending_order() == 0);
+    }
+
     // Checks the side-cross iteration pattern (first, last, second, second-to-last...).
     TEST_CASE("SideCross scan - odd number of elements") {
         MyContainer<int> container;
@@ -289,6 +578,23 @@ TEST_SUITE("Iterator Functionality") {
         CHECK(result == expected);
     }
 
+    // Checks O(1) random access into the side-cross sequence.
+    TEST_CASE("SideCrossIterator random access") {
+        MyContainer<int> container;
+        for (int value : {9, 4, 7, 1, 12, 3}) {
+            container.add(value);
+        }
+        
+        std::vector<int> expected = {1, 12, 3, 9, 4, 7};
+        auto it = container.begin_side_cross_order();
+        for (size_t k = 0; k < expected.size(); ++k) {
+            CHECK(it[k] == expected[k]);
+            CHECK(*(it + k) == expected[k]);
+        }
+        CHECK(it + expected.size() == container.end_side_cross_order());
+        CHECK_THROWS_AS(it[expected.size()], std::out_of_range);
+    }
+
     // Checks the middle-out iteration pattern with an odd number of elements.
     TEST_CASE("MiddleOut scan - odd number of elements") {
         MyContainer<int> container;
@@ -324,6 +630,189 @@ TEST_SUITE("Iterator Functionality") {
         CHECK(result == expected);
     }
 
+    // Checks that OrderIterator is a view over the container storage and does not copy it.
+    TEST_CASE("OrderIterator reads the container storage directly") {
+        MyContainer<int> container;
+        container.add(10);
+        container.add(20);
+        
+        auto it1 = container.begin_order();
+        auto it2 = container.begin_order();
+        CHECK(&*it1 == &*it2);
+        ++it1;
+        ++it2;
+        CHECK(&*it1 == &*it2);
+        CHECK(*it1 == 20);
+    }
+
+#if MYCONTAINER_DEBUG_ITERATORS
+    // Checks that an iterator created before a modification is detected as stale.
+    TEST_CASE("OrderIterator invalidated by add and remove") {
+        MyContainer<int> container;
+        container.add(1);
+        container.add(2);
+        
+        auto it = container.begin_order();
+        container.add(3);
+        CHECK_THROWS_AS(*it, std::runtime_error);
+        
+        auto it2 = container.begin_order();
+        container.remove(1);
+        CHECK_THROWS_AS(*it2, std::runtime_error);
+        
+        auto fresh = container.begin_order();
+        CHECK(*fresh == 2);
+    }
+#endif
+
+    // Checks that every end_*() sentinel matches its iterator exactly after the last element.
+    TEST_CASE("End sentinel matches every iterator type") {
+        MyContainer<int> container;
+        container.add(3);
+        container.add(1);
+        container.add(2);
+        
+        auto order_it = container.begin_order();
+        auto asc_it = container.begin_ascending_order();
+        auto desc_it = container.begin_descending_order();
+        auto side_it = container.begin_side_cross_order();
+        auto middle_it = container.begin_middle_out_order();
+        auto reverse_it = container.begin_reverse_order();
+        for (int i = 0; i < 3; ++i) {
+            CHECK(order_it != container.end_order());
+            CHECK(container.end_ascending_order() != asc_it);
+            ++order_it; ++asc_it; ++desc_it; ++side_it; ++middle_it; ++reverse_it;
+        }
+        CHECK(order_it == container.end_order());
+        CHECK(asc_it == container.end_ascending_order());
+        CHECK(desc_it == container.end_descending_order());
+        CHECK(side_it == container.end_side_cross_order());
+        CHECK(middle_it == container.end_middle_out_order());
+        CHECK(container.end_reverse_order() == reverse_it);
+        
+        MyContainer<int> other;
+        CHECK(other.begin_order() != container.end_order());
+    }
+
+    // Checks O(1) random access into the middle-out sequence and resuming a partial scan.
+    TEST_CASE("MiddleOutIterator random access") {
+        MyContainer<int> container;
+        for (int value : {1, 2, 3, 4, 5, 6, 7}) {
+            container.add(value);
+        }
+        
+        std::vector<int> expected = {4, 3, 5, 2, 6, 1, 7};
+        auto it = container.begin_middle_out_order();
+        for (size_t k = 0; k < expected.size(); ++k) {
+            CHECK(it[k] == expected[k]);
+        }
+        
+        std::vector<int> resumed;
+        for (auto rest = it + 4; rest != container.end_middle_out_order(); ++rest) {
+            resumed.push_back(*rest);
+        }
+        CHECK(resumed == std::vector<int>{6, 1, 7});
+        CHECK_THROWS_AS(it[7], std::out_of_range);
+    }
+
+    // Checks that every iterator type works with standard random-access algorithms.
+    TEST_CASE("Iterators are random access") {
+        MyContainer<int> container;
+        for (int value : {8, 3, 5, 1, 9, 2}) {
+            container.add(value);
+        }
+        
+        auto asc_begin = container.begin_ascending_order();
+        auto asc_end = asc_begin + static_cast<std::ptrdiff_t>(container.size());
+        CHECK(std::distance(asc_begin, asc_end) == 6);
+        CHECK(container.end_ascending_order() - asc_begin == 6);
+        CHECK(*std::lower_bound(asc_begin, asc_end, 4) == 5);
+        CHECK(std::binary_search(asc_begin, asc_end, 9));
+        
+        std::vector<int> copied(container.size());
+        std::copy(container.begin_order(), container.begin_order() + 6, copied.begin());
+        CHECK(copied == std::vector<int>{8, 3, 5, 1, 9, 2});
+        
+        auto desc_last = container.begin_descending_order() + 5;
+        CHECK(*desc_last == 1);
+        --desc_last;
+        CHECK(*desc_last-- == 2);
+        CHECK(*desc_last == 3);
+        CHECK(desc_last[-2] == 8);
+        
+        auto reverse_it = container.begin_reverse_order();
+        reverse_it += 2;
+        CHECK(*reverse_it == 1);
+        reverse_it -= 1;
+        CHECK(*reverse_it == 9);
+        CHECK(container.begin_reverse_order() < reverse_it);
+        CHECK(reverse_it >= container.begin_reverse_order());
+        
+        auto middle_it = container.begin_middle_out_order();
+        CHECK(std::count(middle_it, middle_it + 6, 5) == 1);
+        auto side_it = 3 + container.begin_side_cross_order();
+        CHECK(*side_it == 8);
+        CHECK(side_it - container.begin_side_cross_order() == 3);
+    }
+
+    // Checks range-for over every view of the container.
+    TEST_CASE("Range-for over order views") {
+        MyContainer<int> container;
+        for (int value : {7, 15, 6, 1, 2}) {
+            container.add(value);
+        }
+        
+        auto collect = [](const auto& view) {
+            std::vector<int> result;
+            for (int value : view) {
+                result.push_back(value);
+            }
+            return result;
+        };
+        CHECK(collect(container.in_order()) == std::vector<int>{7, 15, 6, 1, 2});
+        CHECK(collect(container.reversed()) == std::vector<int>{2, 1, 6, 15, 7});
+        CHECK(collect(container.ascending()) == std::vector<int>{1, 2, 6, 7, 15});
+        CHECK(collect(container.descending()) == std::vector<int>{15, 7, 6, 2, 1});
+        CHECK(collect(container.side_cross()) == std::vector<int>{1, 15, 2, 7, 6});
+        CHECK(collect(container.middle_out()) == std::vector<int>{6, 15, 1, 7, 2});
+        
+        const MyContainer<int>& const_ref = container;
+        CHECK(const_ref.ascending().size() == 5);
+        CHECK(const_ref.descending()[1] == 7);
+        CHECK(MyContainer<int>().middle_out().empty());
+    }
+
+#if __cplusplus >= 202002L
+    // Checks that the views compose lazily with standard range adaptors.
+    TEST_CASE("Order views compose with std::views") {
+        static_assert(std::ranges::random_access_range<decltype(MyContainer<int>().ascending())>);
+        static_assert(std::ranges::sized_range<decltype(MyContainer<int>().side_cross())>);
+        static_assert(std::ranges::view<decltype(MyContainer<int>().middle_out())>);
+        
+        MyContainer<int> container;
+        for (int value : {40, 10, 50, 20, 30}) {
+            container.add(value);
+        }
+        
+        std::vector<int> smallest;
+        for (int value : container.ascending() | std::views::take(2)) {
+            smallest.push_back(value);
+        }
+        CHECK(smallest == std::vector<int>{10, 20});
+        
+        std::vector<int> pipeline;
+        auto large = [](int value) { return value > 15; };
+        auto halve = [](int value) { return value / 2; };
+        for (int value : container.descending() | std::views::filter(large) | std::views::transform(halve)) {
+            pipeline.push_back(value);
+        }
+        CHECK(pipeline == std::vector<int>{25, 20, 15, 10});
+        
+        auto found = std::ranges::find(container.in_order(), 50);
+        CHECK(found - container.begin_order() == 2);
+    }
+#endif
+
     // Compares iterators from the same container for equality and inequality.
     TEST_CASE("Compare iterators from same container") {
         MyContainer<int> container;
@@ -354,6 +843,51 @@ TEST_SUITE("Iterator Functionality") {
         CHECK_FALSE(it1 == it2);
         CHECK(it1 != it2);
     }
+    
+    // Scans and copies one const container from several threads at once, each scan forcing its own part of the lazy sort.
+    TEST_CASE("Concurrent scans of a const container") {
+        MyContainer<int> numbers;
+        MyContainer<std::string> words;
+        for (int i = 0; i < 60000; ++i) {
+            numbers.add(i * 7919 % 60000);
+            words.add("w" + std::to_string(i * 7919 % 5000));
+        }
+        const MyContainer<int>& shared_numbers = numbers;
+        const MyContainer<std::string>& shared_words = words;
+        auto ascending = shared_numbers.ascending();
+        auto descending = shared_numbers.descending();
+        auto words_ascending = shared_words.ascending();
+        auto words_descending = shared_words.descending();
+        
+        std::vector<int> low, high, middle;
+        std::vector<std::string> first_words, last_words;
+        std::unique_ptr<MyContainer<int>> numbers_copy;
+        MyContainer<std::string> words_copy;
+        std::vector<std::thread> readers;
+        readers.emplace_back([&] { numbers_copy = std::make_unique<MyContainer<int>>(shared_numbers); });
+        readers.emplace_back([&] { words_copy = shared_words; });
+        readers.emplace_back([&] { for (int i = 0; i < 2000; ++i) low.push_back(ascending.begin()[i]); });
+        readers.emplace_back([&] { for (int i = 0; i < 2000; ++i) high.push_back(descending.begin()[i]); });
+        readers.emplace_back([&] { for (int i = 29000; i < 31000; ++i) middle.push_back(ascending.begin()[i]); });
+        readers.emplace_back([&] { first_words.assign(words_ascending.begin(), words_ascending.begin() + 500); });
+        readers.emplace_back([&] { last_words.assign(words_descending.begin(), words_descending.begin() + 500); });
+        for (std::thread& reader : readers) reader.join();
+        
+        for (int i = 0; i < 2000; ++i) {
+            CHECK(low[i] == i);
+            CHECK(high[i] == 59999 - i);
+            CHECK(middle[i] == 29000 + i);
+        }
+        std::vector<std::string> sorted(words.in_order().begin(), words.in_order().end());
+        std::sort(sorted.begin(), sorted.end());
+        CHECK(std::equal(first_words.begin(), first_words.end(), sorted.begin()));
+        CHECK(std::equal(last_words.begin(), last_words.end(), sorted.rbegin()));
+        
+        std::vector<int> copied(numbers_copy->ascending().begin(), numbers_copy->ascending().end());
+        CHECK(copied.size() == 60000);
+        CHECK(std::is_sorted(copied.begin(), copied.end()));
+        CHECK(std::vector<std::string>(words_copy.ascending().begin(), words_copy.ascending().end()) == sorted);
+    }
 }
 
 TEST_SUITE("Advanced, Edge Cases & Error Handling") {
@@ -380,7 +914,9 @@ TEST_SUITE("Advanced, Edge Cases & Error Handling") {
         MyContainer<int> container;
         container.add(1);
         
-        auto end_it = container.end_order();
+        auto end_it = container.begin_order();
+        ++end_it;
+        CHECK(end_it == container.end_order());
         CHECK_THROWS_AS(*end_it, std::out_of_range);
     }
     
@@ -435,6 +971,35 @@ TEST_SUITE("Advanced, Edge Cases & Error Handling") {
         CHECK(ascending_result == expected);
     }
     
+    // Checks that ordered iterators over strings refer to the stored strings instead of copies.
+    TEST_CASE("String ordered iterators use an index permutation") {
+        MyContainer<std::string> container;
+        container.add("pear");
+        container.add("apple");
+        container.add("fig");
+        
+        auto order_it = container.begin_order();
+        ++order_it;
+        CHECK(&*container.begin_ascending_order() == &*order_it);
+        
+        container.remove("pear");
+        container.add("banana");
+        container.add("apple");
+        container.remove("fig");
+        
+        std::vector<std::string> ascending_result;
+        for (auto it = container.begin_ascending_order(); it != container.end_ascending_order(); ++it) {
+            ascending_result.push_back(*it);
+        }
+        CHECK(ascending_result == std::vector<std::string>{"apple", "apple", "banana"});
+        
+        std::vector<std::string> descending_result;
+        for (auto it = container.begin_descending_order(); it != container.end_descending_order(); ++it) {
+            descending_result.push_back(*it);
+        }
+        CHECK(descending_result == std::vector<std::string>{"banana", "apple", "apple"});
+    }
+    
     // Verifies the container works correctly with double as the template type.
     TEST_CASE("Work with double") {
         MyContainer<double> container;
@@ -475,6 +1040,74 @@ TEST_SUITE("Advanced, Edge Cases & Error Handling") {
         CHECK(ascending_result == std::vector<int>{1, 2, 3, 4});
     }
 
+    // Checks that reading the smallest few elements does not pay for a full sort.
+    TEST_CASE("Lazy ascending scan for top-k") {
+        struct CountedKey {
+            int value;
+            static size_t& comparisons() { static size_t count = 0; return count; }
+            bool operator<(const CountedKey& other) const { ++comparisons(); return value < other.value; }
+            bool operator==(const CountedKey& other) const { return value == other.value; }
+        };
+        
+        const int n = 1 << 14;
+        MyContainer<CountedKey> container;
+        for (int i = 0; i < n; ++i) {
+            container.add(CountedKey{(i * 7919) % n});
+        }
+        
+        CountedKey::comparisons() = 0;
+        auto it = container.begin_ascending_order();
+        for (int k = 0; k < 10; ++k) {
+            CHECK(it[k].value == k);
+        }
+        CHECK(CountedKey::comparisons() < static_cast<size_t>(n) * 8);
+        
+        CHECK(container.begin_descending_order()->value == n - 1);
+        std::vector<int> all;
+        for (auto asc = container.begin_ascending_order(); asc != container.end_ascending_order(); ++asc) {
+            all.push_back(asc->value);
+        }
+        CHECK(all.size() == static_cast<size_t>(n));
+        CHECK(std::is_sorted(all.begin(), all.end()));
+    }
+
+    // Interleaves modifications with partial ordered scans and checks them against a reference.
+    TEST_CASE("Randomized ordered scans against reference") {
+        MyContainer<int> container;
+        std::vector<int> reference;
+        unsigned state = 12345;
+        auto next = [&state]() { state = state * 1103515245u + 12345u; return (state >> 8) % 1000; };
+        
+        for (int round = 0; round < 300; ++round) {
+            unsigned op = next() % 10;
+            if (op < 6 || reference.empty()) {
+                int value = static_cast<int>(next() % 200);
+                container.add(value);
+                reference.push_back(value);
+            }
+            else if (op < 8) {
+                int value = reference[next() % reference.size()];
+                container.remove(value);
+                reference.erase(std::remove(reference.begin(), reference.end(), value), reference.end());
+            }
+            else {
+                std::vector<int> sorted = reference;
+                std::sort(sorted.begin(), sorted.end());
+                size_t n = sorted.size();
+                size_t k = next() % n;
+                CHECK(container.begin_ascending_order()[k] == sorted[k]);
+                CHECK(container.begin_descending_order()[k] == sorted[n - 1 - k]);
+                CHECK(container.begin_side_cross_order()[k] == sorted[k % 2 == 0 ? k / 2 : n - 1 - k / 2]);
+            }
+            if (round % 50 == 49) {
+                std::vector<int> sorted = reference;
+                std::sort(sorted.begin(), sorted.end());
+                std::vector<int> result(container.ascending().begin(), container.ascending().end());
+                CHECK(result == sorted);
+            }
+        }
+    }
+
     // Checks that iterators work correctly on a container with only identical elements.
     TEST_CASE("Container with identical elements") {
         MyContainer<int> container;
@@ -522,4 +1155,1025 @@ TEST_SUITE("Advanced, Edge Cases & Error Handling") {
         CHECK(*middle_it == 4);
         CHECK(*reverse_it == 5);
     }
-}
\ No newline at end of file
+    
+    // Checks contains() and remove() with and without the hash index.
+    TEST_CASE("Hash index membership and removal") {
+        MyContainer<int> container;
+        for (int i = 0; i < 1000; ++i) container.add(i % 10);
+        CHECK(container.contains(3));
+        CHECK_FALSE(container.contains(42));
+        CHECK_FALSE(container.has_hash_index());
+        
+        container.set_hash_index(true);
+        CHECK(container.has_hash_index());
+        container.add(42);
+        CHECK(container.contains(42));
+        CHECK(container.contains(3));
+        
+        int first = *container.begin_ascending_order();
+        CHECK_THROWS_WITH(container.remove(77), "Element was not found in the container");
+        CHECK(container.size() == 1001);
+        CHECK(*container.begin_ascending_order() == first);
+        
+        container.remove(3);
+        CHECK_FALSE(container.contains(3));
+        CHECK(container.size() == 901);
+        CHECK_THROWS_AS(container.remove(3), std::runtime_error);
+        container.add(3);
+        CHECK(container.contains(3));
+        
+        MyContainer<int> copy = container;
+        CHECK(copy.has_hash_index());
+        copy.remove(42);
+        CHECK_FALSE(copy.contains(42));
+        CHECK(container.contains(42));
+        
+        container.set_hash_index(false);
+        CHECK(container.contains(42));
+        CHECK_FALSE(container.contains(77));
+    }
+    
+    // Checks the hash index on strings and with a projection.
+    TEST_CASE("Hash index with strings and projections") {
+        MyContainer<std::string> words;
+        words.add("apple");
+        words.set_hash_index(true);
+        words.add("pear");
+        words.add("apple");
+        CHECK(words.contains("apple"));
+        words.remove("apple");
+        CHECK_FALSE(words.contains("apple"));
+        CHECK(words.size() == 1);
+        
+        auto length = [](const std::string& word) { return word.size(); };
+        MyContainer<std::string, std::less<>, decltype(length)> byLength(std::less<>{}, length);
+        byLength.set_hash_index(true);
+        byLength.add("ccc");
+        byLength.add("a");
+        CHECK(byLength.contains("a"));
+        CHECK_FALSE(byLength.contains("b"));
+        CHECK_THROWS_AS(byLength.remove("b"), std::runtime_error);
+        CHECK(*byLength.begin_ascending_order() == "a");
+    }
+    
+    // Checks that remove_all() reports per-value counts and matches one remove() per present value.
+    TEST_CASE("Batched removal") {
+        MyContainer<int> batched;
+        MyContainer<int> single;
+        for (int i = 0; i < 20000; ++i) {
+            int value = i * 7919 % 5000;
+            batched.add(value);
+            single.add(value);
+        }
+        CHECK(*batched.begin_ascending_order() == *single.begin_ascending_order());
+        
+        std::vector<int> targets;
+        for (int value = 0; value < 6000; value += 3) targets.push_back(value);
+        targets.push_back(3);
+        std::vector<size_t> hits = batched.remove_all(targets);
+        REQUIRE(hits.size() == targets.size());
+        for (size_t i = 0; i < targets.size(); ++i) {
+            if (targets[i] < 5000) {
+                CHECK(hits[i] == 4);
+                if (i + 1 < targets.size()) single.remove(targets[i]);
+            } else {
+                CHECK(hits[i] == 0);
+            }
+        }
+        CHECK(hits.back() == 4);
+        CHECK(batched.size() == single.size());
+        
+        auto batched_ascending = batched.ascending();
+        auto single_ascending = single.ascending();
+        CHECK(std::equal(batched_ascending.begin(), batched_ascending.end(), single_ascending.begin(), single_ascending.end()));
+        CHECK(std::equal(batched.begin_order(), batched.begin_order() + static_cast<std::ptrdiff_t>(batched.size()), single.begin_order()));
+        
+        CHECK(batched.remove_all({-1, -2}) == std::vector<size_t>{0, 0});
+        CHECK(batched.size() == single.size());
+    }
+    
+    // Checks remove_all() on strings with the hash index enabled.
+    TEST_CASE("Batched removal with the hash index") {
+        MyContainer<std::string> words;
+        words.set_hash_index(true);
+        for (const char* word : {"kiwi", "fig", "kiwi", "plum", "fig", "kiwi"}) words.add(word);
+        CHECK(*words.begin_descending_order() == "plum");
+        
+        std::vector<std::string> targets{"kiwi", "lime", "fig"};
+        CHECK(words.remove_all(targets) == std::vector<size_t>{3, 0, 2});
+        CHECK(words.size() == 1);
+        CHECK_FALSE(words.contains("kiwi"));
+        CHECK(words.contains("plum"));
+        CHECK(*words.begin_ascending_order() == "plum");
+    }
+    
+    // Checks that try_remove() reports how many instances went and never throws.
+    TEST_CASE("Non-throwing removal") {
+        MyContainer<int> container;
+        for (int i = 0; i < 1000; ++i) container.add(i * 37 % 100);
+        CHECK(*container.begin_ascending_order() == 0);
+        
+        CHECK(container.try_remove(500) == 0);
+        CHECK(container.size() == 1000);
+        CHECK(container.try_remove(0) == 10);
+        CHECK(container.try_remove(0) == 0);
+        CHECK(container.size() == 990);
+        CHECK(*container.begin_ascending_order() == 1);
+        CHECK_FALSE(container.is_sorted());
+        
+        std::vector<int> expected;
+        for (int i = 0; i < 1000; ++i) if (i * 37 % 100 != 0) expected.push_back(i * 37 % 100);
+        CHECK(std::equal(expected.begin(), expected.end(), container.begin_order()));
+        std::sort(expected.begin(), expected.end());
+        auto ascending = container.ascending();
+        CHECK(std::equal(ascending.begin(), ascending.end(), expected.begin(), expected.end()));
+        
+        MyContainer<std::string> words;
+        words.add("a");
+        words.add("b");
+        words.add("a");
+        CHECK(words.try_remove("a") == 2);
+        CHECK(words.try_remove("c") == 0);
+        CHECK(words.size() == 1);
+    }
+    
+    // Checks remove_if() with a lambda and with ex4::equals, including the hash index.
+    TEST_CASE("Predicate removal") {
+        MyContainer<int> container;
+        container.set_hash_index(true);
+        for (int i = 0; i < 100; ++i) container.add(i % 20);
+        
+        CHECK(container.remove_if([](int value) { return value % 2 == 1; }) == 50);
+        CHECK(container.size() == 50);
+        CHECK_FALSE(container.contains(3));
+        CHECK(container.contains(4));
+        CHECK(container.remove_if([](int value) { return value > 100; }) == 0);
+        
+        CHECK(container.remove_if(equals(4)) == 5);
+        CHECK_FALSE(container.contains(4));
+        CHECK(container.remove_if(equals(4)) == 0);
+        CHECK(*container.begin_descending_order() == 18);
+        CHECK(container.size() == 45);
+        
+        container.add(1);
+        CHECK(container.begin_ascending_order()[5] == 1);
+    }
+    
+    // Collects one order of a container through its view.
+    template<typename View>
+    std::vector<typename View::value_type> collect(const View& view) {
+        return std::vector<typename View::value_type>(view.begin(), view.end());
+    }
+    
+    // Checks that lazily removed elements are invisible to every order and to size().
+    TEST_CASE("Lazy removal matches eager removal") {
+        MyContainer<int> lazy;
+        MyContainer<int> eager;
+        lazy.set_compaction_threshold(1.0);
+        for (int i = 0; i < 2000; ++i) {
+            lazy.add(i * 7919 % 300);
+            eager.add(i * 7919 % 300);
+        }
+        CHECK(*lazy.begin_ascending_order() == *eager.begin_ascending_order());
+        
+        for (int value = 0; value < 300; value += 4) {
+            CHECK(lazy.try_remove(value) == eager.try_remove(value));
+        }
+        lazy.remove(1);
+        eager.remove(1);
+        CHECK_THROWS_AS(lazy.remove(1), std::runtime_error);
+        CHECK(lazy.tombstones() > 0);
+        CHECK(lazy.size() == eager.size());
+        lazy.add(0);
+        eager.add(0);
+        
+        CHECK(collect(lazy.ascending()) == collect(eager.ascending()));
+        CHECK(lazy.tombstones() > 0);
+        CHECK(collect(lazy.in_order()) == collect(eager.in_order()));
+        CHECK(collect(lazy.reversed()) == collect(eager.reversed()));
+        CHECK(collect(lazy.descending()) == collect(eager.descending()));
+        CHECK(collect(lazy.side_cross()) == collect(eager.side_cross()));
+        CHECK(collect(lazy.middle_out()) == collect(eager.middle_out()));
+        
+        lazy.remove(2);
+        eager.remove(2);
+        std::ostringstream lazy_text, eager_text;
+        lazy_text << lazy;
+        eager_text << eager;
+        CHECK(lazy_text.str() == eager_text.str());
+    }
+    
+    // Checks threshold compaction, compact(), and mixing lazy removal with the other removals.
+    TEST_CASE("Lazy removal compaction") {
+        MyContainer<std::string> words;
+        for (int i = 0; i < 100; ++i) words.add("w" + std::to_string(i % 10));
+        words.set_compaction_threshold(0.25);
+        CHECK(words.compaction_threshold() == 0.25);
+        CHECK(*words.begin_descending_order() == "w9");
+        CHECK(collect(words.ascending()).size() == 100);
+        
+        words.remove("w3");
+        words.remove("w5");
+        CHECK(words.tombstones() == 20);
+        CHECK_FALSE(words.contains("w3"));
+        CHECK(collect(words.in_order()).size() == 80);
+        CHECK(words.tombstones() == 20);
+        
+        words.remove("w0");
+        CHECK(words.tombstones() == 0);
+        words.remove("w1");
+        CHECK(words.tombstones() == 10);
+        words.remove("w2");
+        CHECK(words.tombstones() == 0);
+        CHECK(words.size() == 50);
+        
+        words.remove("w4");
+        words.compact();
+        CHECK(words.tombstones() == 0);
+        words.remove("w6");
+        CHECK(words.remove_all({"w7", "w6"}) == std::vector<size_t>{10, 0});
+        CHECK(words.size() == 20);
+        std::vector<std::string> remaining(10, "w8");
+        remaining.resize(20, "w9");
+        CHECK(collect(words.ascending()) == remaining);
+        
+        CHECK_THROWS_AS(words.set_compaction_threshold(1.5), std::invalid_argument);
+        words.remove("w8");
+        words.set_compaction_threshold(0);
+        CHECK(words.tombstones() == 0);
+        CHECK(words.size() == 10);
+    }
+    
+    // Checks that const scans skip tombstones without compacting, including a value removed and added again.
+    TEST_CASE("Lazy removal keeps const scans read-only") {
+        MyContainer<int> lazy;
+        MyContainer<int> eager;
+        lazy.set_compaction_threshold(1.0);
+        for (int i = 0; i < 200; ++i) {
+            lazy.add(i * 37 % 50);
+            eager.add(i * 37 % 50);
+        }
+        CHECK(collect(lazy.ascending()).size() == 200);
+        for (MyContainer<int>* container : {&lazy, &eager}) {
+            container->remove(7);
+            container->add(7);
+            container->remove(9);
+        }
+        
+        const MyContainer<int>& view = lazy;
+        CHECK(view.tombstones() == 8);
+        CHECK(view.contains(7));
+        CHECK_FALSE(view.contains(9));
+        CHECK(collect(view.in_order()) == collect(eager.in_order()));
+        CHECK(collect(view.reversed()) == collect(eager.reversed()));
+        CHECK(collect(view.middle_out()) == collect(eager.middle_out()));
+        CHECK(collect(view.ascending()) == collect(eager.ascending()));
+        CHECK(collect(view.side_cross()) == collect(eager.side_cross()));
+        CHECK(view.begin_order()[100] == eager.begin_order()[100]);
+        CHECK(*(view.begin_reverse_order() + 3) == *(eager.begin_reverse_order() + 3));
+        std::ostringstream lazy_text, eager_text;
+        lazy_text << view;
+        eager_text << eager;
+        CHECK(lazy_text.str() == eager_text.str());
+        CHECK(view.tombstones() == 8);
+        
+        lazy.remove(3);
+        eager.remove(3);
+        lazy.compact();
+        CHECK(lazy.tombstones() == 0);
+        CHECK(collect(lazy.ascending()) == collect(eager.ascending()));
+        CHECK(collect(lazy.in_order()) == collect(eager.in_order()));
+        
+        MyContainer<std::string> words;
+        words.set_compaction_threshold(1.0);
+        for (int i = 0; i < 130; ++i) words.add("w" + std::to_string(i % 13));
+        CHECK(*words.begin_ascending_order() == "w0");
+        words.remove("w0");
+        words.add("w0");
+        words.remove("w12");
+        const MyContainer<std::string>& const_words = words;
+        std::vector<std::string> order = collect(const_words.in_order());
+        CHECK(order.size() == 111);
+        CHECK(order.front() == "w1");
+        CHECK(order.back() == "w0");
+        std::vector<std::string> sorted = order;
+        std::sort(sorted.begin(), sorted.end());
+        CHECK(collect(const_words.ascending()) == sorted);
+        words.compact();
+        CHECK(collect(words.ascending()) == sorted);
+        CHECK(collect(words.in_order()) == order);
+    }
+}
+TEST_SUITE("Sort Kernels") {
+    
+    // Checks the radix sort against std::sort for signed integers, including the extremes.
+    TEST_CASE("Radix sort of integers") {
+        std::vector<long long> values;
+        unsigned long long state = 42;
+        for (int i = 0; i < 5000; ++i) {
+            state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+            values.push_back(static_cast<long long>(state));
+        }
+        values.push_back(std::numeric_limits<long long>::min());
+        values.push_back(std::numeric_limits<long long>::max());
+        values.push_back(0);
+        
+        std::vector<long long> expected = values;
+        std::sort(expected.begin(), expected.end());
+        detail::radix_sort(values.data(), values.data() + values.size());
+        CHECK(values == expected);
+    }
+    
+    // Checks that the float transform orders negatives, -0.0 and +0.0 correctly.
+    TEST_CASE("Radix sort of doubles with negative zero") {
+        std::vector<double> values;
+        for (int i = 0; i < 1000; ++i) {
+            values.push_back((i % 7 - 3) * 1.5 + i * 0.001);
+            values.push_back(i % 2 == 0 ? -0.0 : 0.0);
+        }
+        values.push_back(-std::numeric_limits<double>::infinity());
+        values.push_back(std::numeric_limits<double>::infinity());
+        
+        detail::radix_sort(values.data(), values.data() + values.size());
+        CHECK(std::is_sorted(values.begin(), values.end()));
+        auto zeros = std::equal_range(values.begin(), values.end(), 0.0);
+        CHECK(zeros.second - zeros.first == 1000);
+        CHECK(std::signbit(*zeros.first));
+        CHECK_FALSE(std::signbit(*(zeros.second - 1)));
+        CHECK(std::is_partitioned(zeros.first, zeros.second, [](double value) { return std::signbit(value); }));
+    }
+    
+    // Checks that every container path orders -0.0 before +0.0: the sortedness flag, tail merges, lazy scans and removal.
+    TEST_CASE("Ordered scans with negative zero") {
+        auto signs = [](const auto& view) {
+            std::string text;
+            for (double value : view) text += std::signbit(value) ? '-' : '+';
+            return text;
+        };
+        MyContainer<double> zeros;
+        zeros.add(0.0);
+        zeros.add(-0.0);
+        CHECK_FALSE(zeros.is_sorted());
+        CHECK(signs(zeros.ascending()) == "-+");
+        zeros.add(-0.0);
+        CHECK(signs(zeros.ascending()) == "--+");
+        CHECK(signs(zeros.descending()) == "+--");
+        
+        MyContainer<double> mixed;
+        long zero_count = 0;
+        for (int i = 0; i < 4000; ++i) {
+            double value = i % 3 == 0 ? (i % 2 == 0 ? -0.0 : 0.0) : (i * 7919 % 1000) - 500.0;
+            mixed.add(value);
+            zero_count += value == 0.0;
+        }
+        auto ascending = mixed.ascending();
+        std::vector<double> scanned(ascending.begin(), ascending.end());
+        auto zero_run = std::equal_range(scanned.begin(), scanned.end(), 0.0);
+        CHECK(zero_run.second - zero_run.first == zero_count);
+        CHECK(std::is_partitioned(zero_run.first, zero_run.second, [](double value) { return std::signbit(value); }));
+        CHECK(std::signbit(*zero_run.first));
+        CHECK_FALSE(std::signbit(*(zero_run.second - 1)));
+        
+        CHECK(mixed.try_remove(-0.0) == static_cast<size_t>(zero_count));
+        CHECK(mixed.size() == 4000 - static_cast<size_t>(zero_count));
+        CHECK_FALSE(mixed.contains(0.0));
+        mixed.add(-0.0);
+        mixed.add(0.0);
+        std::vector<double> after(mixed.ascending().begin(), mixed.ascending().end());
+        CHECK(std::is_sorted(after.begin(), after.end()));
+        auto restored = std::equal_range(after.begin(), after.end(), 0.0);
+        CHECK(signs(std::vector<double>(restored.first, restored.second)) == "-+");
+    }
+        
+    // Checks ordered scans of containers large enough to use the radix kernel.
+    TEST_CASE("Ordered scans of large arithmetic containers") {
+        MyContainer<float> container;
+        std::vector<float> expected;
+        for (int i = 0; i < 3000; ++i) {
+            float value = static_cast<float>((i * 7919) % 3001) - 1500.5f;
+            container.add(value);
+            expected.push_back(value);
+        }
+        std::sort(expected.begin(), expected.end());
+        
+        std::vector<float> result(container.ascending().begin(), container.ascending().end());
+        CHECK(result == expected);
+        CHECK(container.begin_descending_order()[0] == expected.back());
+    }
+    
+    // Sorts a copy of values with the network kernel limited to the given instruction set.
+    template<typename T>
+    std::vector<T> network_sorted(std::vector<T> values, detail::SimdLevel level) {
+        detail::set_simd_level_limit(level);
+        detail::network_sort(values.data(), values.data() + values.size());
+        detail::set_simd_level_limit(detail::SimdLevel::avx2);
+        return values;
+    }
+    
+    // Checks that every instruction set produces the same bits as the scalar network and as std::sort.
+    TEST_CASE_TEMPLATE("Sorting network matches the scalar path", T, int, float, double, long long) {
+        for (size_t n : {5u, 17u, 64u, 100u, 777u, 4096u}) {
+            std::vector<T> values;
+            unsigned long long state = n;
+            for (size_t i = 0; i < n; ++i) {
+                state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+                values.push_back(static_cast<T>(static_cast<long long>(state >> 20) % 100000) / static_cast<T>(i % 3 + 1));
+            }
+            values[n / 2] = std::numeric_limits<T>::max();
+            values[n / 3] = std::numeric_limits<T>::lowest();
+            
+            std::vector<T> expected = values;
+            std::sort(expected.begin(), expected.end());
+            std::vector<T> scalar = network_sorted(values, detail::SimdLevel::scalar);
+            CHECK(scalar == expected);
+            for (detail::SimdLevel level : {detail::SimdLevel::sse41, detail::SimdLevel::avx2}) {
+                std::vector<T> vectorized = network_sorted(values, level);
+                CHECK(std::memcmp(vectorized.data(), scalar.data(), n * sizeof(T)) == 0);
+            }
+        }
+    }
+    
+    // Checks that ascending scans produce the same bits whichever instruction set the kernels use.
+    TEST_CASE("Ordered scans match with and without SIMD") {
+        MyContainer<double> container;
+        for (int i = 0; i < 300; ++i) {
+            container.add((i % 11 - 5) * 0.25);
+            container.add(i % 2 == 0 ? -0.0 : 0.0);
+        }
+        MyContainer<double> copy;
+        for (double value : container.in_order()) copy.add(value);
+        
+        detail::set_simd_level_limit(detail::SimdLevel::scalar);
+        std::vector<double> scalar(container.ascending().begin(), container.ascending().end());
+        detail::set_simd_level_limit(detail::SimdLevel::avx2);
+        std::vector<double> vectorized(copy.ascending().begin(), copy.ascending().end());
+        
+        CHECK(std::is_sorted(scalar.begin(), scalar.end()));
+        CHECK(std::memcmp(scalar.data(), vectorized.data(), scalar.size() * sizeof(double)) == 0);
+        CHECK(std::is_sorted(vectorized.begin(), vectorized.end()));
+    }
+    
+    // Checks the prefix string sort on empty strings, proper prefixes, embedded NULs and high bytes.
+    TEST_CASE("String sort of tricky keys") {
+        std::vector<std::string> strings = {"", "a", std::string("a\0", 2), std::string("a\0\0", 3), "ab",
+                                            "\xff", "\x7f", "abcdefgh", "abcdefghi", "abcdefgh", "",
+                                            std::string("abcdefgh\0", 9), "abcdefgg\xff", "zz"};
+        std::string shared(40, 'p');
+        for (int i = 0; i < 200; ++i) strings.push_back(shared + std::to_string(i * 37 % 101));
+        std::vector<size_t> indices;
+        for (size_t i = 0; i < strings.size(); ++i) indices.push_back(i);
+        
+        detail::string_sort(indices.data(), indices.data() + indices.size(), strings.data());
+        std::vector<std::string> result;
+        for (size_t index : indices) result.push_back(strings[index]);
+        std::vector<std::string> expected = strings;
+        std::sort(expected.begin(), expected.end());
+        CHECK(result == expected);
+    }
+    
+    // Checks ordered scans of URL-like strings with long shared prefixes.
+    TEST_CASE("Ordered scans of URL-like strings") {
+        MyContainer<std::string> container;
+        std::vector<std::string> expected;
+        for (int i = 0; i < 500; ++i) {
+            std::string url = "https://www.example.com/" + std::string(i % 3 == 0 ? "docs/" : "docs/archive/") + std::to_string(i * 7919 % 997);
+            container.add(url);
+            expected.push_back(url);
+        }
+        std::sort(expected.begin(), expected.end());
+        CHECK(std::equal(container.ascending().begin(), container.ascending().end(), expected.begin(), expected.end()));
+        CHECK(*container.begin_descending_order() == expected.back());
+    }
+    
+    // Checks strings sharing a megabyte-long prefix, one sort level per eight bytes, and many copies of one long string.
+    TEST_CASE("Ordered scans of strings with a very long shared prefix") {
+        const std::string prefix(1 << 20, 'p');
+        MyContainer<std::string> container;
+        std::vector<std::string> expected;
+        for (int i = 0; i < 16; ++i) {
+            std::string value = prefix + std::to_string(i * 7 % 16);
+            container.add(value);
+            expected.push_back(value);
+        }
+        std::sort(expected.begin(), expected.end());
+        CHECK(std::equal(container.ascending().begin(), container.ascending().end(), expected.begin(), expected.end()));
+        
+        MyContainer<std::string> copies;
+        for (int i = 0; i < 16; ++i) copies.add(prefix);
+        copies.add("a");
+        CHECK(*copies.begin_ascending_order() == "a");
+        CHECK(copies.begin_ascending_order()[16] == prefix);
+    }
+    
+    // Checks the parallel merge sort against std::sort with uneven chunks and an odd thread count.
+    TEST_CASE("Parallel merge sort") {
+        std::vector<int> values;
+        unsigned long long state = 7;
+        for (size_t i = 0; i < 5 * detail::parallel_sort_min_chunk + 123; ++i) {
+            state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+            values.push_back(static_cast<int>(state >> 40) % 1000);
+        }
+        std::vector<int> expected = values;
+        std::sort(expected.begin(), expected.end());
+        
+        auto less = [](int a, int b) { return a < b; };
+        detail::parallel_merge_sort(values.data(), values.data() + values.size(), less, 3,
+                                    [&](int* from, int* to) { std::sort(from, to, less); });
+        CHECK(values == expected);
+    }
+    
+    // Checks that per-container and global thread settings are resolved and copied.
+    TEST_CASE("Sort thread settings") {
+        MyContainer<int> container;
+        set_default_sort_threads(3);
+        CHECK(default_sort_threads() == 3);
+        CHECK(container.sort_threads() == 3);
+        container.set_sort_threads(5);
+        CHECK(container.sort_threads() == 5);
+        MyContainer<int> copy(container);
+        CHECK(copy.sort_threads() == 5);
+        set_default_sort_threads(0);
+        CHECK(default_sort_threads() >= 1);
+        container.set_sort_threads(0);
+        CHECK(container.sort_threads() == default_sort_threads());
+    }
+    
+    // Checks that large snapshots sort to the same bits on one thread and on several.
+    TEST_CASE("Parallel ordered scans match the serial ones") {
+        MyContainer<double> serial;
+        MyContainer<std::string> serial_strings;
+        for (size_t i = 0; i < 2 * detail::parallel_sort_min_chunk + 99; ++i) {
+            double value = static_cast<double>((i * 2654435761u) % 100003) - 50000.0;
+            serial.add(i % 5 == 0 ? (i % 2 == 0 ? -0.0 : 0.0) : value);
+            if (i % 4 == 0) serial_strings.add(std::to_string(value));
+        }
+        MyContainer<double> parallel(serial);
+        MyContainer<std::string> parallel_strings(serial_strings);
+        serial.set_sort_threads(1);
+        serial_strings.set_sort_threads(1);
+        parallel.set_sort_threads(4);
+        parallel_strings.set_sort_threads(4);
+        
+        std::vector<double> expected(serial.ascending().begin(), serial.ascending().end());
+        std::vector<double> result(parallel.ascending().begin(), parallel.ascending().end());
+        CHECK(std::memcmp(result.data(), expected.data(), expected.size() * sizeof(double)) == 0);
+        CHECK(std::equal(parallel_strings.ascending().begin(), parallel_strings.ascending().end(),
+                         serial_strings.ascending().begin()));
+    }
+    
+    // Checks the natural merge sort on runs, descending runs and jitter, including stability.
+    TEST_CASE("Natural merge sort") {
+        std::vector<std::pair<int, int>> values;
+        for (int i = 0; i < 3000; ++i) values.push_back({i / 3, i});
+        for (int i = 3000; i > 0; --i) values.push_back({i % 500, -i});
+        unsigned long long state = 11;
+        for (int i = 0; i < 3000; ++i) {
+            state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+            values.push_back({i + static_cast<int>(state >> 58), 10000 + i});
+        }
+        auto less = [](const std::pair<int, int>& a, const std::pair<int, int>& b) { return a.first < b.first; };
+        std::vector<std::pair<int, int>> expected = values;
+        std::stable_sort(expected.begin(), expected.end(), less);
+        
+        detail::natural_merge_sort(values.data(), values.data() + values.size(), less);
+        CHECK(values == expected);
+    }
+    
+    // Checks that the sortedness flag follows add() and remove().
+    TEST_CASE("Sortedness flag") {
+        MyContainer<int> container;
+        CHECK(container.is_sorted());
+        for (int value : {1, 2, 2, 5}) container.add(value);
+        CHECK(container.is_sorted());
+        container.add(3);
+        CHECK_FALSE(container.is_sorted());
+        container.add(4);
+        CHECK_FALSE(container.is_sorted());
+        container.remove(5);
+        CHECK(container.is_sorted());
+        container.add(0);
+        container.remove(0);
+        CHECK(container.is_sorted());
+        
+        MyContainer<int, std::greater<>> reversed;
+        for (int value : {9, 4, 4, 1}) reversed.add(value);
+        CHECK(reversed.is_sorted());
+    }
+    
+    // Checks that sorted input is scanned without sorting (only std::is_sorted compares) and nearly sorted input cheaply.
+    TEST_CASE("Ordered scans of sorted and nearly sorted input") {
+        struct CountedKey {
+            int value;
+            static size_t& comparisons() { static size_t count = 0; return count; }
+            bool operator<(const CountedKey& other) const { ++comparisons(); return value < other.value; }
+            bool operator==(const CountedKey& other) const { return value == other.value; }
+        };
+        
+        const int n = 1 << 14;
+        MyContainer<CountedKey> sorted;
+        MyContainer<CountedKey> jittered;
+        for (int i = 0; i < n; ++i) {
+            sorted.add(CountedKey{i});
+            jittered.add(CountedKey{i * 4 + (i * 7919) % 11});
+        }
+        
+        CountedKey::comparisons() = 0;
+        CHECK(sorted.begin_descending_order()->value == n - 1);
+        CHECK(std::is_sorted(sorted.begin_ascending_order(), sorted.begin_ascending_order() + n));
+        CHECK(CountedKey::comparisons() == static_cast<size_t>(n) - 1);
+        
+        CountedKey::comparisons() = 0;
+        std::vector<int> all;
+        for (const CountedKey& key : jittered.ascending()) all.push_back(key.value);
+        CHECK(std::is_sorted(all.begin(), all.end()));
+        CHECK(CountedKey::comparisons() < static_cast<size_t>(n) * 4);
+    }
+    
+    // Checks the running minimum, maximum and distinct-count estimate.
+    TEST_CASE("Value statistics") {
+        detail::value_stats<int> stats;
+        for (int i = 0; i < 20000; ++i) stats.add((i * 7919) % 1000 - 500);
+        CHECK(stats.min == -500);
+        CHECK(stats.max == 499);
+        CHECK(stats.distinct_estimate() > 750);
+        CHECK(stats.distinct_estimate() < 1250);
+        
+        detail::value_stats<double> few;
+        for (int i = 0; i < 1000; ++i) few.add(i % 2 == 0 ? -0.0 : 0.0);
+        CHECK(std::signbit(few.min));
+        CHECK_FALSE(std::signbit(few.max));
+        CHECK(few.distinct_estimate() == 2);
+    }
+    
+    // Checks which strategy is chosen for tiny, sorted, nearly sorted, narrow, duplicated and wide inputs.
+    TEST_CASE("Sort strategy selection") {
+        detail::value_stats<int> narrow;
+        detail::value_stats<int> duplicated;
+        detail::value_stats<int> wide;
+        for (int i = 0; i < 10000; ++i) {
+            narrow.add(i % 1001);
+            duplicated.add((i % 10) * 100000000);
+            wide.add(i * 104729);
+        }
+        CHECK(detail::choose_sort_strategy(10, 3, wide) == detail::SortStrategy::insertion);
+        CHECK(detail::choose_sort_strategy(10000, 0, wide) == detail::SortStrategy::none);
+        CHECK(detail::choose_sort_strategy(10000, 100, wide) == detail::SortStrategy::natural_merge);
+        CHECK(detail::choose_sort_strategy(10000, 5000, narrow) == detail::SortStrategy::counting);
+        CHECK(detail::choose_sort_strategy(10000, 5000, duplicated) == detail::SortStrategy::dictionary);
+        CHECK(detail::choose_sort_strategy(10000, 5000, wide) == detail::SortStrategy::radix);
+    }
+    
+    // Checks the counting and dictionary sorts against std::sort.
+    TEST_CASE("Counting and dictionary sorts") {
+        std::vector<int> narrow;
+        std::vector<double> duplicated;
+        std::vector<int> many;
+        for (int i = 0; i < 5000; ++i) {
+            narrow.push_back((i * 7919) % 301 - 150);
+            duplicated.push_back(i % 3 == 0 ? (i % 2 == 0 ? -0.0 : 0.0) : (i % 7) * -1.5e300);
+            many.push_back(i * 31 % 997);
+        }
+        std::vector<int> expected_narrow = narrow;
+        std::sort(expected_narrow.begin(), expected_narrow.end());
+        detail::counting_sort(narrow.data(), narrow.data() + narrow.size(), -150, 150);
+        CHECK(narrow == expected_narrow);
+        
+        CHECK(detail::dictionary_sort(duplicated.data(), duplicated.data() + duplicated.size()));
+        CHECK(std::is_sorted(duplicated.begin(), duplicated.end()));
+        auto zeros = std::equal_range(duplicated.begin(), duplicated.end(), 0.0);
+        CHECK(std::is_partitioned(zeros.first, zeros.second, [](double value) { return std::signbit(value); }));
+        
+        std::vector<int> untouched = many;
+        CHECK_FALSE(detail::dictionary_sort(many.data(), many.data() + many.size()));
+        CHECK(many == untouched);
+    }
+    
+    // Checks ordered scans of narrow-range integers, with statistics rebuilt by remove().
+    TEST_CASE("Ordered scans of narrow-range integers") {
+        MyContainer<short> container;
+        std::vector<short> expected;
+        for (int i = 0; i < 4000; ++i) {
+            short value = static_cast<short>((i * 7919) % 1001 - 20);
+            container.add(value);
+            if (value != -20 && value != 980) expected.push_back(value);
+        }
+        container.remove(-20);
+        container.remove(980);
+        std::sort(expected.begin(), expected.end());
+        CHECK(std::equal(container.ascending().begin(), container.ascending().end(), expected.begin(), expected.end()));
+    }
+    
+    // Checks that the vectorized compaction keeps exactly the elements the scalar one keeps, in order.
+    TEST_CASE_TEMPLATE("Compaction kernel matches the scalar path", T, int, float, double, long long) {
+        for (size_t n : {0u, 3u, 8u, 31u, 64u, 1001u}) {
+            std::vector<T> values;
+            unsigned long long state = n + 7;
+            for (size_t i = 0; i < n; ++i) {
+                state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+                values.push_back(static_cast<T>(static_cast<long long>(state >> 33) % 5));
+            }
+            
+            std::vector<T> expected;
+            for (T value : values) if (!(value == T(2))) expected.push_back(value);
+            for (detail::SimdLevel level : {detail::SimdLevel::scalar, detail::SimdLevel::avx2}) {
+                std::vector<T> compacted = values;
+                detail::set_simd_level_limit(level);
+                size_t kept = detail::compress_not_equal(compacted.data(), compacted.size(), T(2));
+                detail::set_simd_level_limit(detail::SimdLevel::avx2);
+                compacted.resize(kept);
+                CHECK(compacted == expected);
+            }
+        }
+    }
+    
+    // Checks that the vectorized compaction follows operator== on signed zeros and NaN.
+    TEST_CASE("Compaction kernel uses floating-point equality") {
+        const double nan = std::numeric_limits<double>::quiet_NaN();
+        std::vector<double> values{0.0, -0.0, 1.0, nan, -0.0, 2.0, 0.0, nan, 3.0};
+        std::vector<double> zeros_dropped = values;
+        zeros_dropped.resize(detail::compress_not_equal(zeros_dropped.data(), zeros_dropped.size(), 0.0));
+        REQUIRE(zeros_dropped.size() == 5);
+        CHECK(zeros_dropped[0] == 1.0);
+        CHECK(std::isnan(zeros_dropped[1]));
+        CHECK(zeros_dropped[4] == 3.0);
+        
+        std::vector<double> nan_kept = values;
+        CHECK(detail::compress_not_equal(nan_kept.data(), nan_kept.size(), nan) == values.size());
+    }
+}
+
+// Record ordered by a derived key in the projection tests.
+struct Record {
+    std::string name;
+    int score;
+    bool operator==(const Record& other) const { return name == other.name && score == other.score; }
+};
+
+// Projection that counts how many times it is called.
+struct CountingScore {
+    int* calls;
+    int operator()(const Record& record) const { ++*calls; return record.score; }
+};
+
+TEST_SUITE("Comparators & Projections") {
+    
+    // Checks that a custom comparator defines the ascending order and everything derived from it.
+    TEST_CASE("Custom comparator") {
+        MyContainer<int, std::greater<>> container;
+        for (int value : {7, 15, 6, 1, 2}) container.add(value);
+        
+        std::vector<int> ascending(container.ascending().begin(), container.ascending().end());
+        std::vector<int> descending(container.descending().begin(), container.descending().end());
+        std::vector<int> side_cross(container.side_cross().begin(), container.side_cross().end());
+        CHECK(ascending == std::vector<int>{15, 7, 6, 2, 1});
+        CHECK(descending == std::vector<int>{1, 2, 6, 7, 15});
+        CHECK(side_cross == std::vector<int>{15, 1, 7, 2, 6});
+        
+        container.remove(7);
+        CHECK(*container.begin_ascending_order() == 15);
+        CHECK(container.begin_ascending_order()[1] == 6);
+    }
+    
+    // Checks that the projection runs once per element, not once per comparison.
+    TEST_CASE("Projected keys are computed once") {
+        int calls = 0;
+        MyContainer<Record, std::less<>, CountingScore> container(std::less<>{}, CountingScore{&calls});
+        for (int i = 0; i < 1000; ++i) container.add(Record{"r" + std::to_string(i), i * 7919 % 1000});
+        CHECK(calls == 1000);
+        
+        std::vector<int> scores;
+        for (const Record& record : container.ascending()) scores.push_back(record.score);
+        CHECK(calls == 1000);
+        CHECK(std::is_sorted(scores.begin(), scores.end()));
+        
+        container.add(Record{"late", -1});
+        CHECK(container.begin_ascending_order()->name == "late");
+        CHECK(calls == 1001);
+        
+        container.remove(Record{"late", -1});
+        CHECK(calls == 1002);
+        CHECK(container.begin_ascending_order()->score == 0);
+        CHECK(container.size() == 1000);
+    }
+    
+    // Checks a member pointer as projection together with a comparator on the projected key.
+    TEST_CASE("Member pointer projection") {
+        MyContainer<Record, std::greater<>, int Record::*> container(std::greater<>{}, &Record::score);
+        container.add(Record{"a", 3});
+        container.add(Record{"b", 9});
+        container.add(Record{"c", 5});
+        container.add(Record{"d", 9});
+        
+        CHECK(container.begin_ascending_order()->score == 9);
+        CHECK(container.begin_descending_order()->name == "a");
+        container.remove(Record{"b", 9});
+        std::vector<std::string> names;
+        for (const Record& record : container.ascending()) names.push_back(record.name);
+        CHECK(names == std::vector<std::string>{"d", "c", "a"});
+    }
+    
+    // Checks that add_range() projects every new element exactly once.
+    TEST_CASE("Bulk add with a projection") {
+        int calls = 0;
+        MyContainer<Record, std::less<>, CountingScore> records(std::less<>{}, CountingScore{&calls});
+        records.add(Record{"w", 3});
+        std::vector<Record> batch{Record{"x", 2}, Record{"y", 1}, Record{"z", 4}};
+        records.add_range(batch);
+        CHECK(calls == 4);
+        CHECK(records.begin_ascending_order()->name == "y");
+        CHECK(records.begin_descending_order()->name == "z");
+        CHECK(calls == 4);
+    }
+    
+    // Checks remove_all() on a type without std::hash, with a projection.
+    TEST_CASE("Batched removal without std::hash") {
+        MyContainer<Record, std::less<>, int Record::*> container(std::less<>{}, &Record::score);
+        container.add(Record{"a", 3});
+        container.add(Record{"b", 1});
+        container.add(Record{"c", 2});
+        container.add(Record{"a", 3});
+        CHECK(container.begin_ascending_order()->name == "b");
+        
+        std::vector<Record> targets{Record{"a", 3}, Record{"z", 0}, Record{"b", 1}};
+        CHECK(container.remove_all(targets) == std::vector<size_t>{2, 0, 1});
+        CHECK(container.size() == 1);
+        CHECK(container.begin_ascending_order()->name == "c");
+    }
+    
+    // Checks remove_all() without std::hash on targets that share keys, against one try_remove() per target.
+    TEST_CASE("Batched removal of targets with equivalent keys") {
+        int calls = 0;
+        MyContainer<Record, std::less<>, CountingScore> batched(std::less<>{}, CountingScore{&calls});
+        MyContainer<Record, std::less<>, CountingScore> single(std::less<>{}, CountingScore{&calls});
+        for (int i = 0; i < 3000; ++i) {
+            Record record{"r" + std::to_string(i % 7), i * 7919 % 300};
+            batched.add(record);
+            single.add(record);
+        }
+        std::vector<Record> targets;
+        for (int i = 0; i < 400; i += 3) targets.push_back(Record{"r" + std::to_string(i % 7), i % 300});
+        targets.push_back(targets[5]);
+        targets.push_back(Record{"missing", 5});
+        CHECK(batched.begin_ascending_order()->score == 0);
+        
+        calls = 0;
+        std::vector<size_t> counts = batched.remove_all(targets);
+        CHECK(calls == static_cast<int>(targets.size()));
+        for (size_t i = 0; i < targets.size(); ++i) {
+            size_t expected = single.try_remove(targets[i]);
+            CHECK(counts[i] == (i == targets.size() - 2 ? counts[5] : expected));
+        }
+        CHECK(batched.size() == single.size());
+        std::vector<Record> batched_order(batched.in_order().begin(), batched.in_order().end());
+        std::vector<Record> single_order(single.in_order().begin(), single.in_order().end());
+        CHECK(batched_order == single_order);
+        std::vector<int> scores;
+        for (const Record& record : batched.ascending()) scores.push_back(record.score);
+        CHECK(std::is_sorted(scores.begin(), scores.end()));
+    }
+}
+
+TEST_SUITE("Counted Container") {
+    
+    // Checks that millions of copies of a few values are stored as a few runs.
+    TEST_CASE("Identical elements are stored once") {
+        CountedContainer<int> container;
+        for (int i = 0; i < 3000000; ++i) container.add(i % 3);
+        container.add(7, 1000000);
+        
+        CHECK(container.size() == 4000000);
+        CHECK(container.distinct_size() == 4);
+        CHECK(container.count(0) == 1000000);
+        CHECK(container.count(7) == 1000000);
+        CHECK(container.count(5) == 0);
+        CHECK(*container.begin_ascending_order() == 0);
+        CHECK(container.begin_ascending_order()[2999999] == 2);
+        CHECK(container.begin_ascending_order()[3000000] == 7);
+        CHECK(*container.begin_descending_order() == 7);
+    }
+    
+    // Checks that add, remove and size behave like MyContainer.
+    TEST_CASE("Add, remove and size semantics") {
+        CountedContainer<int> container;
+        CHECK(container.size() == 0);
+        CHECK(container.begin_ascending_order() == container.end_ascending_order());
+        
+        container.add(4);
+        container.add(2);
+        container.add(4);
+        container.add(9);
+        container.add(3, 0);
+        CHECK(container.size() == 4);
+        CHECK(container.distinct_size() == 3);
+        
+        std::ostringstream os;
+        os << container;
+        CHECK(os.str() == "[2, 4, 4, 9]");
+        
+        container.remove(4);
+        CHECK(container.size() == 2);
+        CHECK(container.count(4) == 0);
+        CHECK_THROWS_AS(container.remove(4), std::runtime_error);
+        CHECK_THROWS_WITH(container.remove(100), "Element was not found in the container");
+    }
+    
+    // Checks every ordered scan against MyContainer on random data with many duplicates.
+    TEST_CASE("Scans match MyContainer") {
+        CountedContainer<int> counted;
+        MyContainer<int> plain;
+        for (int i = 0; i < 5000; ++i) {
+            int value = static_cast<int>((i * 2654435761u) % 37) - 18;
+            counted.add(value);
+            plain.add(value);
+        }
+        counted.remove(0);
+        plain.remove(0);
+        
+        auto counted_ascending = counted.ascending();
+        auto counted_descending = counted.descending();
+        auto counted_side_cross = counted.side_cross();
+        auto plain_ascending = plain.ascending();
+        auto plain_descending = plain.descending();
+        auto plain_side_cross = plain.side_cross();
+        CHECK(std::equal(counted_ascending.begin(), counted_ascending.end(), plain_ascending.begin(), plain_ascending.end()));
+        CHECK(std::equal(counted_descending.begin(), counted_descending.end(), plain_descending.begin(), plain_descending.end()));
+        CHECK(std::equal(counted_side_cross.begin(), counted_side_cross.end(), plain_side_cross.begin(), plain_side_cross.end()));
+        
+        std::vector<int> viewed;
+        for (int x : counted.descending()) viewed.push_back(x);
+        CHECK(viewed.size() == counted.size());
+        CHECK(std::is_sorted(viewed.rbegin(), viewed.rend()));
+    }
+    
+    // Checks a custom comparator, which also decides which values are duplicates.
+    TEST_CASE("Custom comparator") {
+        auto by_length = [](const std::string& a, const std::string& b) { return a.size() < b.size(); };
+        CountedContainer<std::string, decltype(by_length)> container(by_length);
+        container.add("ccc");
+        container.add("a");
+        container.add("bbb");
+        container.add("dd");
+        
+        CHECK(container.distinct_size() == 3);
+        CHECK(container.count("xyz") == 2);
+        auto ascending = container.ascending();
+        std::vector<std::string> words(ascending.begin(), ascending.end());
+        CHECK(words == std::vector<std::string>{"a", "dd", "ccc", "ccc"});
+    }
+    
+    // Checks that copies and moves scan their own runs, even after the source is gone.
+    TEST_CASE("Copy and move") {
+        auto source = std::make_unique<CountedContainer<std::string>>();
+        source->add(std::string(40, 'b'), 2);
+        source->add(std::string(40, 'a'));
+        CHECK(*source->begin_ascending_order() == std::string(40, 'a'));
+        
+        CountedContainer<std::string> copy(*source);
+        CountedContainer<std::string> assigned;
+        assigned.add("x");
+        CHECK(*assigned.begin_ascending_order() == "x");
+        assigned = *source;
+        source.reset();
+        std::vector<std::string> expected{std::string(40, 'a'), std::string(40, 'b'), std::string(40, 'b')};
+        CHECK(std::vector<std::string>(copy.ascending().begin(), copy.ascending().end()) == expected);
+        CHECK(std::vector<std::string>(assigned.ascending().begin(), assigned.ascending().end()) == expected);
+        
+        CountedContainer<std::string> moved(std::move(copy));
+        CHECK(copy.size() == 0);
+        CHECK(copy.begin_ascending_order() == copy.end_ascending_order());
+        CHECK(std::vector<std::string>(moved.descending().begin(), moved.descending().end())
+              == std::vector<std::string>(expected.rbegin(), expected.rend()));
+        assigned = std::move(moved);
+        CHECK(moved.size() == 0);
+        CHECK(assigned.begin_descending_order()[2] == std::string(40, 'a'));
+    }
+    
+        // Scans one const container from several threads, each starting its own scan after a modification.
+    TEST_CASE("Concurrent scans") {
+        CountedContainer<int> counted;
+        for (int value = 0; value < 1000; ++value) counted.add(value, 3);
+        counted.remove(500);
+        const CountedContainer<int>& shared = counted;
+        std::vector<int> ascending, descending;
+        std::thread up([&] { for (int value : shared.ascending()) ascending.push_back(value); });
+        std::thread down([&] { for (int value : shared.descending()) descending.push_back(value); });
+        up.join();
+        down.join();
+        CHECK(ascending.size() == 2997);
+        CHECK(std::is_sorted(ascending.begin(), ascending.end()));
+        CHECK(std::equal(ascending.begin(), ascending.end(), descending.rbegin()));
+        CHECK(std::count(ascending.begin(), ascending.end(), 500) == 0);
+    }
+    
+#if MYCONTAINER_DEBUG_ITERATORS
+    // Checks that an iterator created before a modification is detected in debug builds.
+    TEST_CASE("Stale iterator detection") {
+        CountedContainer<int> container;
+        container.add(1);
+        container.add(2);
+        auto it = container.begin_ascending_order();
+        container.add(1);
+        CHECK_THROWS_AS(*it, std::runtime_error);
+    }
+#endif
+}